@@ -0,0 +1,210 @@
+#include "asyncDB.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+AsyncDB::~AsyncDB() {
+    for (db_conn* c : m_conns) {
+        delete c->conn;
+        delete c;
+    }
+    if (m_eventfd != -1)
+        close(m_eventfd);
+    if (m_epollfd != -1)
+        close(m_epollfd);
+}
+
+// 建立异步连接，并把连接的socket和唤醒用的eventfd注册到内部epoll中
+bool AsyncDB::init(ConnectionPool* conn_pool) {
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollfd == -1 || m_eventfd == -1) {
+        LOG("异步查询初始化失败");
+        return false;
+    }
+    epoll_event ev;
+    ev.data.ptr = nullptr;  // data.ptr为空表示eventfd
+    ev.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_eventfd, &ev);
+
+    for (int i = 0; i < conn_pool->get_async_size(); ++i) {
+        Connection* conn = conn_pool->create_connection(true);
+        if (!conn) {
+            continue;
+        }
+        db_conn* c = new db_conn;
+        c->conn = conn;
+        c->mysql = conn->get();
+        c->state = DB_IDLE;
+        // 边沿触发同时监听读写，状态机返回NOT_READY后等待下一次状态变化即可
+        ev.data.ptr = c;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, c->mysql->net.fd, &ev);
+        m_conns.push_back(c);
+        m_idle.push_back(c);
+    }
+    return !m_conns.empty();
+}
+
+// 提交查询，只入队并唤醒主循环，真正的发送在主线程中完成
+bool AsyncDB::submit(const string& sql, db_callback cb) {
+    if (m_conns.empty()) {
+        return false;
+    }
+    m_lock.lock();
+    if (m_tasks.size() >= MAX_DB_TASKS) {
+        m_lock.unlock();
+        return false;
+    }
+    m_tasks.push(db_task{sql, std::move(cb)});
+    m_lock.unlock();
+    uint64_t one = 1;
+    write(m_eventfd, &one, sizeof(one));
+    return true;
+}
+
+// 回调约定在主线程执行，提交失败时也不在调用者的线程中直接回调
+void AsyncDB::fail_later(db_callback cb) {
+    m_lock.lock();
+    m_failed.push_back(std::move(cb));
+    m_lock.unlock();
+    uint64_t one = 1;
+    write(m_eventfd, &one, sizeof(one));
+}
+
+// 转义只依赖连接的字符集，不会与该连接上进行中的查询冲突
+string AsyncDB::escape(const string& str) {
+    string out(str.size() * 2 + 1, '\0');
+    unsigned long len = mysql_real_escape_string(m_conns.front()->mysql,
+                                                 &out[0], str.c_str(),
+                                                 str.size());
+    out.resize(len);
+    return out;
+}
+
+void AsyncDB::dispatch() {
+    epoll_event events[MAX_DB_EVENTS];
+    int number = epoll_wait(m_epollfd, events, MAX_DB_EVENTS, 0);
+    for (int i = 0; i < number; ++i) {
+        db_conn* c = (db_conn*)events[i].data.ptr;
+        if (!c) {
+            // 有新提交的任务，清空eventfd计数
+            uint64_t cnt;
+            read(m_eventfd, &cnt, sizeof(cnt));
+        } else if (c->state != DB_IDLE) {
+            drive(c);
+        }
+    }
+    std::vector<db_callback> failed;
+    m_lock.lock();
+    failed.swap(m_failed);
+    m_lock.unlock();
+    for (db_callback& cb : failed) {
+        cb(false, 0, nullptr);
+    }
+    schedule();
+}
+
+void AsyncDB::schedule() {
+    while (!m_idle.empty()) {
+        m_lock.lock();
+        if (m_tasks.empty()) {
+            m_lock.unlock();
+            break;
+        }
+        db_conn* c = m_idle.back();
+        m_idle.pop_back();
+        c->task = std::move(m_tasks.front());
+        m_tasks.pop();
+        m_lock.unlock();
+        c->state = DB_QUERY;
+        drive(c);
+    }
+}
+
+// 状态机：DB_QUERY发送查询并等待应答，有结果集时进入DB_STORE读取结果集
+// 任何一步返回NET_ASYNC_NOT_READY都直接返回，等socket下一次就绪时再继续
+void AsyncDB::drive(db_conn* c) {
+    net_async_status status;
+    if (c->state == DB_QUERY) {
+        const string& sql = c->task.sql;
+        status = mysql_real_query_nonblocking(c->mysql, sql.c_str(),
+                                              sql.size());
+        if (status == NET_ASYNC_NOT_READY) {
+            return;
+        }
+        if (status == NET_ASYNC_ERROR) {
+            fail(c);
+            return;
+        }
+        if (mysql_field_count(c->mysql) == 0) {
+            // insert、update等没有结果集的语句
+            finish(c, true, nullptr);
+            return;
+        }
+        c->state = DB_STORE;
+    }
+    if (c->state == DB_STORE) {
+        MYSQL_RES* res = nullptr;
+        status = mysql_store_result_nonblocking(c->mysql, &res);
+        if (status == NET_ASYNC_NOT_READY) {
+            return;
+        }
+        if (status == NET_ASYNC_ERROR) {
+            fail(c);
+            return;
+        }
+        finish(c, res != nullptr, res);
+    }
+}
+
+// wait_timeout到期或者MySQL重启后连接已经断开，不重连的话这条连接上之后的查询都会失败
+void AsyncDB::fail(db_conn* c) {
+    unsigned int err = mysql_errno(c->mysql);
+    if ((err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) &&
+        !c->task.retried) {
+        LOG("异步查询连接断开，重新连接：" + string(mysql_error(c->mysql)));
+        c->task.retried = true;
+        if (revive(c)) {
+            c->state = DB_QUERY;
+            drive(c);
+            return;
+        }
+    }
+    finish(c, false, nullptr);
+}
+
+// 重连只在断开时发生，阻塞建立连接的时间可以接受；失败时连接保持未连接状态，
+// 下一个查询会再次得到CR_SERVER_GONE_ERROR并重试重连
+bool AsyncDB::revive(db_conn* c) {
+    if (c->mysql->net.fd >= 0) {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, c->mysql->net.fd, nullptr);
+    }
+    bool ok = c->conn->reconnect();
+    c->mysql = c->conn->get();
+    if (!ok) {
+        return false;
+    }
+    epoll_event ev;
+    ev.data.ptr = c;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, c->mysql->net.fd, &ev);
+    return true;
+}
+
+void AsyncDB::finish(db_conn* c, bool ok, MYSQL_RES* res) {
+    db_task task = std::move(c->task);
+    unsigned int err = ok ? 0 : mysql_errno(c->mysql);
+    if (!ok) {
+        LOG("异步查询失败：" + task.sql + " " + mysql_error(c->mysql));
+    }
+    c->state = DB_IDLE;
+    m_idle.push_back(c);
+    if (task.cb) {
+        task.cb(ok, err, res);
+    }
+    if (res) {
+        mysql_free_result(res);
+    }
+}
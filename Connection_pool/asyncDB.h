@@ -0,0 +1,86 @@
+#ifndef ASYNCDB_H
+#define ASYNCDB_H
+
+#include <sys/epoll.h>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+#include "../locker/locker.h"
+#include "connectionPool.h"
+
+using std::string;
+
+/*
+    基于MySQL非阻塞接口(mysql_*_nonblocking)的异步查询层
+    1. 持有少量专用连接，每条连接的socket以边沿触发注册到内部的epoll中
+    2. 内部epoll的文件描述符本身交给主循环的epoll监听，主线程在其可读时调用dispatch推进各连接的状态机
+    3. 工作线程通过submit提交SQL后立即返回，请求被挂起，查询完成后在主线程中回调，由回调负责恢复请求
+    这样数据库变慢时不会占住工作线程，少量线程即可支撑大量并发的数据库请求
+*/
+
+// 查询完成的回调，ok表示执行是否成功，err为失败时的MySQL错误码，
+// res为查询的结果集（非查询语句为nullptr），回调返回后结果集会被释放
+typedef std::function<void(bool ok, unsigned int err, MYSQL_RES* res)>
+    db_callback;
+
+class AsyncDB {
+   public:
+    static AsyncDB* get_instance() {
+        static AsyncDB async_db;
+        return &async_db;
+    }
+
+    // 按连接池的配置建立连接，成功返回true
+    bool init(ConnectionPool* conn_pool);
+    // 是否可用，不可用时调用者应退回到同步的连接池
+    bool available() const { return !m_conns.empty(); }
+    // 内部epoll的文件描述符，需要加入主循环的epoll中
+    int get_fd() const { return m_epollfd; }
+    // 提交一条SQL，任意线程均可调用，队列满时返回false
+    bool submit(const string& sql, db_callback cb);
+    // submit失败时使用：把失败回调投递到主线程，由dispatch以ok为false调用，任意线程均可调用
+    void fail_later(db_callback cb);
+    // 转义字符串，用于拼接到SQL中（非阻塞接口不支持预处理语句）
+    string escape(const string& str);
+    // 主循环在get_fd()可读时调用，推进所有就绪连接并派发排队的查询
+    void dispatch();
+
+   private:
+    // 单条连接的状态：空闲、发送查询并等待应答、读取结果集
+    enum DB_STATE { DB_IDLE = 0, DB_QUERY, DB_STORE };
+
+    struct db_task {
+        string sql;
+        db_callback cb;
+        bool retried = false;  // 是否已经因为连接断开重连后重试过
+    };
+
+    struct db_conn {
+        Connection* conn;
+        MYSQL* mysql;
+        DB_STATE state;
+        db_task task;
+    };
+
+    static const int MAX_DB_EVENTS = 64;
+    static const int MAX_DB_TASKS = 10000;
+
+    AsyncDB() : m_epollfd(-1), m_eventfd(-1) {}
+    ~AsyncDB();
+    void schedule();          // 把排队的查询分配给空闲连接
+    void drive(db_conn* c);   // 推进一条连接的状态机
+    void fail(db_conn* c);    // 查询出错：连接断开时重连并重试一次，否则以失败结束
+    bool revive(db_conn* c);  // 重新建立断开的连接并注册到内部epoll
+    void finish(db_conn* c, bool ok, MYSQL_RES* res);  // 查询结束，回调并归还连接
+
+    int m_epollfd;                  // 内部epoll，监听所有连接的socket和m_eventfd
+    int m_eventfd;                  // 工作线程提交任务后用来唤醒主循环
+    std::vector<db_conn*> m_conns;  // 全部连接
+    std::vector<db_conn*> m_idle;   // 空闲连接，只在主线程中访问
+    std::queue<db_task> m_tasks;    // 等待执行的查询，被所有线程共享
+    std::vector<db_callback> m_failed;  // 等待在主线程中通知失败的回调
+    locker m_lock;                  // 保护m_tasks和m_failed
+};
+
+#endif
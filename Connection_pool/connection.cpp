@@ -1,14 +1,19 @@
 #include "connection.h"
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
 
 // 初始化数据库连接
-Connection::Connection() {
+Connection::Connection() : _port(3306), _nonblocking(false), _errno(0) {
     _conn = mysql_init(nullptr);
     // LOG("初始化成功");
 }
 
 // 关闭数据库连接
 Connection::~Connection() {
-    if (!_conn)
+    clear_stmts();
+    if (_conn)
         mysql_close(_conn);
 }
 
@@ -17,7 +22,28 @@ bool Connection::connect(string ip,
                          string user,
                          string password,
                          string dbname,
-                         unsigned int port) {
+                         unsigned int port,
+                         bool nonblocking) {
+    _ip = ip;
+    _user = user;
+    _password = password;
+    _dbname = dbname;
+    _port = port;
+    _nonblocking = nonblocking;
+    if (nonblocking) {
+        // 非阻塞建立连接，只在启动时调用，这里直接轮询等待连接完成
+        net_async_status status;
+        while ((status = mysql_real_connect_nonblocking(
+                    _conn, ip.c_str(), user.c_str(), password.c_str(),
+                    dbname.c_str(), port, nullptr, 0)) == NET_ASYNC_NOT_READY) {
+            struct pollfd pfd = {_conn->net.fd, POLLIN | POLLOUT, 0};
+            if (pfd.fd < 0 || poll(&pfd, 1, 100) < 0) {
+                usleep(1000);
+            }
+        }
+        if (status == NET_ASYNC_ERROR) LOG("连接失败");
+        return status != NET_ASYNC_ERROR;
+    }
     MYSQL* p =
         mysql_real_connect(_conn, ip.c_str(), user.c_str(), password.c_str(),
                            dbname.c_str(), port, nullptr, 0);
@@ -41,4 +67,181 @@ MYSQL_RES* Connection::query(string& sql) {
         return nullptr;
     }
     return mysql_store_result(_conn);
+}
+
+// 流式读取结果集，内存占用与结果集大小无关
+bool Connection::stream_query(const string& sql, const row_handler& handler) {
+    if (mysql_real_query(_conn, sql.c_str(), sql.size())) {
+        _errno = mysql_errno(_conn);
+        LOG("查询失败：" + sql);
+        return false;
+    }
+    MYSQL_RES* res = mysql_use_result(_conn);
+    if (!res) {
+        _errno = mysql_errno(_conn);
+        return false;
+    }
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(res)) != nullptr) {
+        handler(row, mysql_fetch_lengths(res));
+    }
+    // fetch_row返回空既可能是读完了也可能是出错
+    _errno = mysql_errno(_conn);
+    mysql_free_result(res);
+    return _errno == 0;
+}
+
+// 释放缓存的预处理语句
+void Connection::clear_stmts() {
+    for (auto& it : _stmts) {
+        mysql_stmt_close(it.second);
+    }
+    _stmts.clear();
+}
+
+// 重新建立连接，旧连接上的预处理语句全部作废
+bool Connection::reconnect() {
+    clear_stmts();
+    if (_conn)
+        mysql_close(_conn);
+    _conn = mysql_init(nullptr);
+    return connect(_ip, _user, _password, _dbname, _port, _nonblocking);
+}
+
+// 同一条SQL只预处理一次，之后直接复用语句句柄
+MYSQL_STMT* Connection::prepare(const string& sql) {
+    auto it = _stmts.find(sql);
+    if (it != _stmts.end()) {
+        return it->second;
+    }
+    MYSQL_STMT* stmt = mysql_stmt_init(_conn);
+    if (!stmt) {
+        _errno = mysql_errno(_conn);
+        return nullptr;
+    }
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size())) {
+        _errno = mysql_stmt_errno(stmt);
+        LOG("预处理失败：" + sql + " " + mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    _stmts[sql] = stmt;
+    return stmt;
+}
+
+// 绑定参数并执行，连接断开时自动重连、重新预处理后再执行一次
+MYSQL_STMT* Connection::run(const string& sql,
+                            const std::vector<stmt_param>& params) {
+    for (int retry = 0; retry < 2; ++retry) {
+        MYSQL_STMT* stmt = prepare(sql);
+        if (stmt && mysql_stmt_param_count(stmt) != params.size()) {
+            LOG("预处理参数个数不匹配：" + sql);
+            return nullptr;
+        }
+        if (stmt) {
+            std::vector<MYSQL_BIND> binds(params.size());
+            std::vector<unsigned long> lengths(params.size());
+            for (size_t i = 0; i < params.size(); ++i) {
+                MYSQL_BIND& b = binds[i];
+                memset(&b, 0, sizeof(b));
+                b.buffer_type = params[i].type;
+                if (params[i].type == MYSQL_TYPE_STRING) {
+                    lengths[i] = params[i].str.size();
+                    b.buffer = (void*)params[i].str.data();
+                    b.buffer_length = lengths[i];
+                    b.length = &lengths[i];
+                } else {
+                    b.buffer = (void*)&params[i].num;
+                }
+            }
+            if (!mysql_stmt_bind_param(stmt, binds.data()) &&
+                !mysql_stmt_execute(stmt)) {
+                _errno = 0;
+                return stmt;
+            }
+            _errno = mysql_stmt_errno(stmt);
+        } else if (_errno == 0) {
+            _errno = mysql_errno(_conn);
+        }
+        if (_errno != CR_SERVER_GONE_ERROR && _errno != CR_SERVER_LOST) {
+            break;
+        }
+        LOG("数据库连接断开，重新连接");
+        if (!reconnect()) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+// 以预处理语句执行更新
+bool Connection::execute(const string& sql,
+                         const std::vector<stmt_param>& params,
+                         unsigned long long* affected) {
+    MYSQL_STMT* stmt = run(sql, params);
+    if (!stmt) {
+        LOG("执行失败：" + sql);
+        return false;
+    }
+    if (affected) {
+        *affected = mysql_stmt_affected_rows(stmt);
+    }
+    return true;
+}
+
+// 以预处理语句执行查询，按二进制协议逐行读取结果
+bool Connection::execute_query(const string& sql,
+                               const std::vector<stmt_param>& params,
+                               std::vector<stmt_row>& rows) {
+    MYSQL_STMT* stmt = run(sql, params);
+    if (!stmt) {
+        LOG("查询失败：" + sql);
+        return false;
+    }
+    unsigned int columns = mysql_stmt_field_count(stmt);
+    // 每列先用一个固定大小的缓冲区，数据被截断时再按实际长度单独取
+    const unsigned long COLUMN_BUFFER_SIZE = 256;
+    std::vector<MYSQL_BIND> binds(columns);
+    std::vector<std::vector<char>> buffers(
+        columns, std::vector<char>(COLUMN_BUFFER_SIZE));
+    std::vector<unsigned long> lengths(columns);
+    std::unique_ptr<bool[]> nulls(new bool[columns]());
+    for (unsigned int i = 0; i < columns; ++i) {
+        MYSQL_BIND& b = binds[i];
+        memset(&b, 0, sizeof(b));
+        b.buffer_type = MYSQL_TYPE_STRING;
+        b.buffer = buffers[i].data();
+        b.buffer_length = COLUMN_BUFFER_SIZE;
+        b.length = &lengths[i];
+        b.is_null = &nulls[i];
+    }
+    if (columns && mysql_stmt_bind_result(stmt, binds.data())) {
+        _errno = mysql_stmt_errno(stmt);
+        mysql_stmt_free_result(stmt);
+        return false;
+    }
+    int ret;
+    while ((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED) {
+        stmt_row row(columns);
+        for (unsigned int i = 0; i < columns; ++i) {
+            if (nulls[i]) {
+                continue;
+            }
+            if (lengths[i] <= COLUMN_BUFFER_SIZE) {
+                row[i].assign(buffers[i].data(), lengths[i]);
+                continue;
+            }
+            // 被截断的列按实际长度重新获取
+            row[i].resize(lengths[i]);
+            MYSQL_BIND b;
+            memset(&b, 0, sizeof(b));
+            b.buffer_type = MYSQL_TYPE_STRING;
+            b.buffer = &row[i][0];
+            b.buffer_length = lengths[i];
+            mysql_stmt_fetch_column(stmt, &b, i, 0);
+        }
+        rows.push_back(std::move(row));
+    }
+    mysql_stmt_free_result(stmt);
+    return ret == MYSQL_NO_DATA;
 }
\ No newline at end of file
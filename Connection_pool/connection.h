@@ -1,9 +1,13 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
 #include <mysql/mysql.h>
+#include <chrono>
 #include <ctime>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 /* 宏定义，用于打印日志 */
 #define LOG(str)                                                              \
@@ -15,6 +19,22 @@ using std::cout;
 using std::endl;
 using std::string;
 
+/* 预处理语句的参数，目前支持字符串和整数两种类型 */
+struct stmt_param {
+    stmt_param(const string& s) : type(MYSQL_TYPE_STRING), str(s), num(0) {}
+    stmt_param(const char* s) : type(MYSQL_TYPE_STRING), str(s), num(0) {}
+    stmt_param(long long n) : type(MYSQL_TYPE_LONGLONG), num(n) {}
+    enum_field_types type;
+    string str;
+    long long num;
+};
+
+/* 预处理语句查询结果的一行，各列统一以字符串返回，NULL返回空串 */
+typedef std::vector<string> stmt_row;
+
+/* 流式查询逐行回调，row和lengths只在回调期间有效 */
+typedef std::function<void(MYSQL_ROW row, unsigned long* lengths)> row_handler;
+
 /* 遵循RAII标准，对MySQL连接进行封装 */
 class Connection {
    public:
@@ -22,27 +42,70 @@ class Connection {
     Connection();
     // 析构连接
     ~Connection();
-    // 连接数据库
+    // 连接数据库，nonblocking为true时使用MySQL的非阻塞接口建立连接，
+    // 之后该连接才能使用*_nonblocking系列接口（见AsyncDB）
     bool connect(string ip,
                  string user,
                  string password,
                  string dbname,
-                 unsigned int port = 3306);
+                 unsigned int port = 3306,
+                 bool nonblocking = false);
     // 更新操作 insert、delete、update
     bool update(string& sql);
     // 查询操作 select
     MYSQL_RES* query(string& sql);
-    // 刷新一下起始的空闲时间点
-    void refresh_alive_time() { _alive_time = clock(); }
-    // 返回存活的时间
-    clock_t get_alive_time() const {
-        // 存活的时间即：当前的时间-起始的时间点
-        return clock() - _alive_time;
+    // 以预处理语句执行insert、delete、update，affected返回影响的行数
+    bool execute(const string& sql,
+                 const std::vector<stmt_param>& params,
+                 unsigned long long* affected = nullptr);
+    // 以预处理语句执行select，结果按二进制协议读取后存入rows
+    bool execute_query(const string& sql,
+                       const std::vector<stmt_param>& params,
+                       std::vector<stmt_row>& rows);
+    // 流式查询（mysql_use_result），结果集不在客户端缓存，边读边回调，适合扫描大表
+    // 回调期间不能在同一连接上执行其他语句
+    bool stream_query(const string& sql, const row_handler& handler);
+    // 断开后用原来的参数（包括是否非阻塞）重新连接，缓存的预处理语句随之失效，下次使用时重新预处理
+    bool reconnect();
+    // 最近一次失败的错误码
+    unsigned int last_errno() const { return _errno; }
+    // 获取底层的MySQL句柄
+    MYSQL* get() { return _conn; }
+    // 检查连接是否还可用
+    bool ping() { return mysql_ping(_conn) == 0; }
+    // 刷新一下起始的空闲时间点，刚用过的连接同时视为已验证
+    void refresh_alive_time() {
+        _alive_time = std::chrono::steady_clock::now();
+        _check_time = _alive_time;
     }
+    // 返回空闲的时间，单位毫秒
+    long long get_alive_time() const { return elapsed_ms(_alive_time); }
+    // 刷新最近一次健康检查的时间点
+    void refresh_check_time() { _check_time = std::chrono::steady_clock::now(); }
+    // 距离上一次健康检查的时间，单位毫秒
+    long long get_check_time() const { return elapsed_ms(_check_time); }
 
    private:
+    MYSQL_STMT* prepare(const string& sql);  // 从缓存中取预处理语句，没有则预处理并缓存
+    MYSQL_STMT* run(const string& sql, const std::vector<stmt_param>& params);
+    void clear_stmts();  // 释放全部缓存的预处理语句
+    static long long elapsed_ms(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - t)
+            .count();
+    }
+
     MYSQL* _conn;
-    clock_t _alive_time;  // 记录进入空闲状态后的起始时间点(应该在进入队列的时候更新时间点)  
+    // 每条连接各自缓存预处理语句，以SQL文本为键
+    std::unordered_map<string, MYSQL_STMT*> _stmts;
+    // 连接参数，重连时使用
+    string _ip, _user, _password, _dbname;
+    unsigned int _port;
+    bool _nonblocking;  // 是否以非阻塞接口建立的连接
+    unsigned int _errno;
+    // 记录进入空闲状态后的起始时间点(在进入队列的时候更新时间点)，使用单调时钟
+    std::chrono::steady_clock::time_point _alive_time;
+    std::chrono::steady_clock::time_point _check_time;  // 最近一次确认连接可用的时间点
 };
 
 #endif
\ No newline at end of file
@@ -1,5 +1,13 @@
 #include "connectionPool.h"
 
+// 线程私有的连接缓存，线程退出时把缓存的连接还给全局队列
+struct conn_stash {
+    ConnectionPool* pool = nullptr;
+    std::vector<Connection*> conns;
+    ~conn_stash();
+};
+static thread_local conn_stash t_stash;
+
 // 懒汉单例模式，只有调用get函数时才生成对象
 ConnectionPool* ConnectionPool::get_pool() {
     static ConnectionPool m_pool;
@@ -44,20 +52,46 @@ bool ConnectionPool::deal_config() {
             m_max_idletime = atoi(val.c_str());
         else if (key == "connectionTimeout")
             m_timeout = atoi(val.c_str());
+        else if (key == "pingInterval")
+            m_ping_interval = atoi(val.c_str());
+        else if (key == "threadCacheSize")
+            m_thread_cache_size = atoi(val.c_str());
+        else if (key == "asyncSize")
+            m_async_size = atoi(val.c_str());
+        else if (key == "batchSize")
+            m_batch_size = atoi(val.c_str());
+        else if (key == "batchWindow")
+            m_batch_window = atoi(val.c_str());
     }
     return true;
 }
 
 // 数据库连接池的构造函数
-ConnectionPool::ConnectionPool() : m_port(3306) {
+ConnectionPool::ConnectionPool()
+    : m_port(3306),
+      m_init_size(10),
+      m_max_size(1024),
+      m_max_idletime(30),
+      m_timeout(100),
+      m_ping_interval(30),
+      m_async_size(4),
+      m_batch_size(64),
+      m_batch_window(2),
+      m_thread_cache_size(2),
+      m_connection_cnt(0),
+      m_waiters(0),
+      m_stashed(0) {
     // 预处理，用配置文件对数据库连接池要连接的数据库属性进行配置，就不需要重新编译代码了
     if (!deal_config()) {
         LOG("未能完成连接池的初始化");
         return;
     }
-    for (size_t i = 0; i < m_init_size; ++i) {
-        Connection* p = new Connection();
-        p->connect(m_ip, m_user, m_password, m_dbname);
+    // initSize作为连接池的最小连接数
+    for (int i = 0; i < m_init_size; ++i) {
+        Connection* p = create_connection();
+        if (!p) {
+            break;
+        }
         p->refresh_alive_time();
         m_connection_queue.push(p);
         m_connection_cnt++;
@@ -81,6 +115,16 @@ ConnectionPool::ConnectionPool() : m_port(3306) {
     }
 }
 
+// 按配置文件新建一个连接，连接失败返回nullptr
+Connection* ConnectionPool::create_connection(bool nonblocking) {
+    Connection* p = new Connection();
+    if (!p->connect(m_ip, m_user, m_password, m_dbname, m_port, nonblocking)) {
+        delete p;
+        return nullptr;
+    }
+    return p;
+}
+
 void ConnectionPool::print() {
     cout << m_ip;
     cout << m_user;
@@ -90,90 +134,207 @@ void ConnectionPool::print() {
     cout << m_init_size;
     cout << m_max_size;
     cout << m_max_idletime;
-    cout << m_timeout << endl;
+    cout << m_timeout;
+    cout << m_ping_interval << endl;
 }
 
 // 生产者用于生产连接的函数
+// 只有在有消费者等待、没有空闲连接并且总数未达上限时才新建连接，连接池因此能在负载升高时扩容到maxSize
 void* ConnectionPool::produce_connection(void* arg) {
     ConnectionPool* pool = (ConnectionPool*)arg;
     while (true) {
-        // 利用unique_lock在一个while循环内实现自动加锁解锁
         pool->m_queue_mutex.lock();
-        while (!pool->m_connection_queue.empty()) {
-            // 队列内还有空闲连接
-            /* 先unlock之前获得的mutex，然后阻塞当前的执行线程。把当前线程添加到等待线程列表中，该线程会持续
-             * block 直到被 notify_all() 或 notify_one()
-             * 唤醒。被唤醒后，该thread会重新获取mutex，获取到mutex后执行后面的动作*/
-            pool->cv.wait(pool->m_queue_mutex.get());
+        while (pool->m_waiters == 0 || !pool->m_connection_queue.empty() ||
+               pool->m_connection_cnt >= pool->m_max_size) {
+            pool->m_produce_cv.wait(pool->m_queue_mutex.get());
         }
-        // 总的连接数不能超过上限
-        if (pool->m_connection_cnt >= pool->m_max_size)
-            continue;
-        Connection* p = new Connection();
-        p->connect(pool->m_ip, pool->m_user, pool->m_password, pool->m_dbname,
-                   pool->m_port);
-        // p->connect("localhost", "root", "root", "chat");
-        p->refresh_alive_time();
-        pool->m_connection_queue.push(p);
+        // 先占住名额，建立连接比较慢，期间不持有锁
         ++pool->m_connection_cnt;
-        // 生产完毕，通知可以使用
-        pool->cv.broadcast();
         pool->m_queue_mutex.unlock();
+
+        Connection* p = pool->create_connection();
+        pool->m_queue_mutex.lock();
+        if (p) {
+            p->refresh_alive_time();
+            pool->m_connection_queue.push(p);
+            // 生产完毕，通知一个等待的消费者
+            pool->cv.signal();
+        } else {
+            --pool->m_connection_cnt;
+        }
+        pool->m_queue_mutex.unlock();
+        if (!p) {
+            // 数据库暂时不可用，避免空转
+            sleep(1);
+        }
     }
+    return nullptr;
 }
 
 // 定时器线程的处理函数
+// 1. 空闲超过maxIdleTime且总数多于initSize的连接被回收
+// 2. 超过pingInterval没有验证过的连接用mysql_ping检查，失效的重连，重连失败的丢弃
 void* ConnectionPool::scan_connection_time(void* arg) {
-    ConnectionPool* pool = (ConnectionPool*) arg;
-    // 扫描队列里全部的节点，将超过最大允许存活时间的去掉
+    ConnectionPool* pool = (ConnectionPool*)arg;
+    long long max_idle_ms = (long long)pool->m_max_idletime * 1000;
+    long long ping_ms = (long long)pool->m_ping_interval * 1000;
     while (true) {
-        sleep(pool->m_max_idletime);
+        sleep(SCAN_INTERVAL);
+        std::vector<Connection*> expired, to_check;
         pool->m_queue_mutex.lock();
-        while (pool->m_connection_cnt) {
+        size_t n = pool->m_connection_queue.size();
+        for (size_t i = 0; i < n; ++i) {
             Connection* p = pool->m_connection_queue.front();
-            // cout << p->get_alive_time() << endl;
-            if (p->get_alive_time() > pool->m_max_idletime * 100 &&
-                pool->m_connection_cnt > pool->m_init_size / 2 + 1) {
-                pool->m_connection_queue.pop();
+            pool->m_connection_queue.pop();
+            if (p->get_alive_time() > max_idle_ms &&
+                pool->m_connection_cnt > pool->m_init_size) {
                 --pool->m_connection_cnt;
-                delete p;
+                expired.push_back(p);
+            } else if (p->get_check_time() > ping_ms) {
+                to_check.push_back(p);
             } else {
-                // 队头的连接没有超时则后面的肯定不会超时
-                break;
+                pool->m_connection_queue.push(p);
             }
         }
         pool->m_queue_mutex.unlock();
+
+        for (Connection* p : expired) {
+            delete p;
+        }
+        // ping可能阻塞，在锁外进行，检查完再放回队列
+        for (Connection* p : to_check) {
+            if (!p->ping() && !p->reconnect()) {
+                LOG("数据库连接失效，已丢弃");
+                delete p;
+                pool->m_queue_mutex.lock();
+                --pool->m_connection_cnt;
+                // 有人在等时让生产者补上
+                pool->m_produce_cv.signal();
+                pool->m_queue_mutex.unlock();
+                continue;
+            }
+            p->refresh_check_time();
+            pool->m_queue_mutex.lock();
+            pool->m_connection_queue.push(p);
+            pool->cv.signal();
+            pool->m_queue_mutex.unlock();
+        }
     }
+    return nullptr;
 }
 
 // 消费者线程用来获取连接的函数
+// 最多等待connectionTimeout毫秒，超时返回nullptr，由调用者快速返回错误（HTTP层返回503）
 std::shared_ptr<Connection> ConnectionPool::get_connection() {
+    // 优先使用本线程缓存的连接，不碰全局队列和锁
+    Connection* stashed = take_stashed();
+    if (stashed) {
+        return std::shared_ptr<Connection>(
+            stashed, [this](Connection* tmp) { release_connection(tmp); });
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += m_timeout / 1000;
+    deadline.tv_nsec += (long)(m_timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
     m_queue_mutex.lock();
     while (m_connection_queue.empty()) {
-        // 等待队列为空
-        // cv.notify_all();  // 让生产队列生产一个连接出来
-        // if (std::cv_status::timeout ==
-        //     cv.wait(lock, std::chrono::milliseconds(m_timeout))) {
-        //     // 如果不是被唤醒，而是因为超时了
-        //     if (m_connection_queue.empty()) {
-        //         LOG("申请连接失败");
-        //         return nullptr;
-        //     }
-        // }
-        cv.wait(m_queue_mutex.get());
+        // 没有空闲连接，登记为等待者并通知生产者扩容
+        ++m_waiters;
+        m_produce_cv.signal();
+        bool woken = cv.timedwait(m_queue_mutex.get(), deadline);
+        --m_waiters;
+        if (!woken && m_connection_queue.empty()) {
+            m_queue_mutex.unlock();
+            LOG("获取数据库连接超时");
+            return nullptr;
+        }
     }
-    // 使用智能指针，并重写删除器，将原始指针归还到队列里面而不是析构
-    std::shared_ptr<Connection> p(m_connection_queue.front(),
-                                  [this](Connection* tmp) {
-                                      // std::unique_lock<std::mutex>
-                                      // lock(m_queue_mutex);
-                                      m_queue_mutex.lock();
-                                      tmp->refresh_alive_time();
-                                      m_connection_queue.push(tmp);
-                                      m_queue_mutex.unlock();
-                                  });
+    Connection* conn = m_connection_queue.front();
     m_connection_queue.pop();
-    cv.broadcast();  // 消费者取出一个，通知生产者生产
     m_queue_mutex.unlock();
-    return p;
-}
\ No newline at end of file
+    // 使用智能指针，并重写删除器，将原始指针归还到队列里面而不是析构
+    return std::shared_ptr<Connection>(
+        conn, [this](Connection* tmp) { release_connection(tmp); });
+}
+
+// 线程缓存中的连接不经过扫描线程，取出时自己做空闲回收和健康检查：
+// 空闲超过maxIdleTime且总数多于initSize的丢弃，超过pingInterval没有验证过的先ping，失效的重连
+Connection* ConnectionPool::take_stashed() {
+    long long max_idle_ms = (long long)m_max_idletime * 1000;
+    long long ping_ms = (long long)m_ping_interval * 1000;
+    while (!t_stash.conns.empty()) {
+        Connection* conn = t_stash.conns.back();
+        t_stash.conns.pop_back();
+        --m_stashed;
+        if (conn->get_alive_time() > max_idle_ms) {
+            m_queue_mutex.lock();
+            bool surplus = m_connection_cnt > m_init_size;
+            if (surplus) {
+                --m_connection_cnt;
+            }
+            m_queue_mutex.unlock();
+            if (surplus) {
+                delete conn;
+                continue;
+            }
+        }
+        if (conn->get_check_time() > ping_ms) {
+            if (!conn->ping() && !conn->reconnect()) {
+                LOG("数据库连接失效，已丢弃");
+                discard(conn);
+                continue;
+            }
+            conn->refresh_check_time();
+        }
+        return conn;
+    }
+    return nullptr;
+}
+
+void ConnectionPool::discard(Connection* conn) {
+    delete conn;
+    m_queue_mutex.lock();
+    --m_connection_cnt;
+    // 有人在等时让生产者补上
+    m_produce_cv.signal();
+    m_queue_mutex.unlock();
+}
+
+// 归还连接：本线程缓存未满时留在本线程，否则还给全局队列
+// 缓存的连接仍然计入m_connection_cnt，但别的线程拿不到，所以所有线程缓存的总数不超过maxSize的一半，
+// 有消费者在全局队列上等待时也直接还回去
+void ConnectionPool::release_connection(Connection* conn) {
+    if ((int)t_stash.conns.size() < m_thread_cache_size && m_waiters == 0) {
+        // 先占名额再检查，多个线程同时归还时总数也不会超过上限
+        if (m_stashed.fetch_add(1) < m_max_size / 2) {
+            conn->refresh_alive_time();
+            t_stash.pool = this;
+            t_stash.conns.push_back(conn);
+            return;
+        }
+        --m_stashed;
+    }
+    release_to_queue(conn);
+}
+
+// 归还到全局队列，唤醒一个等待的消费者
+void ConnectionPool::release_to_queue(Connection* conn) {
+    m_queue_mutex.lock();
+    conn->refresh_alive_time();
+    m_connection_queue.push(conn);
+    cv.signal();
+    m_queue_mutex.unlock();
+}
+
+conn_stash::~conn_stash() {
+    for (Connection* conn : conns) {
+        --pool->m_stashed;
+        pool->release_to_queue(conn);
+    }
+}
@@ -1,6 +1,7 @@
 #ifndef CONNECTIONPOOL_H
 #define CONNECTIONPOOL_H
 
+#include <atomic>
 #include <cstring>
 #include <functional>
 #include <iostream>
@@ -8,6 +9,8 @@
 #include <queue>
 #include <string>
 #include <thread>
+#include <vector>
+#include <time.h>
 #include <unistd.h>
 #include "../locker/locker.h"
 #include "connection.h"
@@ -17,11 +20,22 @@ using std::string;
 using std::thread;
 
 class ConnectionPool {
+    friend struct conn_stash;
+
    public:
     // 对外部提供一个接口，用来获取单例线程池
     static ConnectionPool* get_pool();
-    // 消费者获取一个连接
+    // 消费者获取一个连接，等待超过connectionTimeout毫秒返回nullptr
     std::shared_ptr<Connection> get_connection();
+    // 按配置新建一个不归连接池管理的连接，由调用者负责释放（AsyncDB使用）
+    Connection* create_connection(bool nonblocking = false);
+    // 异步查询使用的连接数量
+    int get_async_size() const { return m_async_size; }
+    // 注册批量提交的每批行数与等待窗口（毫秒）
+    int get_batch_size() const { return m_batch_size; }
+    int get_batch_window() const { return m_batch_window; }
+    // 每个线程私有缓存的连接数上限，0表示关闭线程缓存（压测对比用）
+    void set_thread_cache_size(int size) { m_thread_cache_size = size; }
     // 测试代码用，可删除，用于打印所有的私有成员变量
     void print();
     ~ConnectionPool() = default;
@@ -32,21 +46,35 @@ class ConnectionPool {
     string m_password;    // 数据库的密码
     string m_dbname;      // 数据库使用的库名
     unsigned int m_port;  // 数据库的端口号
-    int m_init_size;      // 数据库连接池的初始线程数量
-    int m_max_size;       // 数据库连接池的最大线程数量
-    int m_max_idletime;   // 数据库连接池各线程最大空闲时间
-    int m_timeout;        // 数据库连接池获取连接的超时时间
+    int m_init_size;      // 数据库连接池的初始（最小）连接数量
+    int m_max_size;       // 数据库连接池的最大连接数量
+    int m_max_idletime;   // 数据库连接池各连接最大空闲时间，单位秒
+    int m_timeout;        // 数据库连接池获取连接的超时时间，单位毫秒
+    int m_ping_interval;  // 空闲连接的健康检查间隔，单位秒
+    int m_async_size;     // 异步查询（AsyncDB）使用的连接数量
+    int m_batch_size;     // 注册批量提交的每批最大行数
+    int m_batch_window;   // 注册批量提交的最长等待时间，单位毫秒
+    int m_thread_cache_size;  // 每个线程私有缓存的连接数上限
     // 连接队列，用于存放连接池中的所有连接
     queue<Connection*> m_connection_queue;
     locker m_queue_mutex;  // 队列锁，维护线程安全
-    int m_connection_cnt;  // 原子操作，保存现在拥有的连接数量
-    cond cv;  // 条件变量，用于连接生产者和消费者之间的通信
+    int m_connection_cnt;  // 保存现在拥有的连接数量（包括线程缓存中的），受m_queue_mutex保护
+    std::atomic<int> m_waiters;  // 正在等待连接的消费者数量，只在m_queue_mutex内修改
+    std::atomic<int> m_stashed;  // 所有线程缓存中的连接总数，不超过maxSize的一半
+    cond cv;               // 有连接可用时通知消费者
+    cond m_produce_cv;     // 有消费者在等待时通知生产者
+
+    static const int SCAN_INTERVAL = 1;  // 扫描线程的检查间隔，单位秒
 
    private:
     ConnectionPool();    // 单例模式，构造函数私有
     bool deal_config();  // 处理配置文件，从配置文件加载配置项
     static void* produce_connection(void* arg);    // 生产者生产一个连接
     static void* scan_connection_time(void* arg);  // 定时器的处理函数
+    void release_connection(Connection* conn);     // 归还连接
+    void release_to_queue(Connection* conn);       // 归还到全局队列
+    Connection* take_stashed();                    // 取出本线程缓存中仍然可用的连接
+    void discard(Connection* conn);                // 丢弃失效的连接，让出名额
 };
 
 #endif
\ No newline at end of file
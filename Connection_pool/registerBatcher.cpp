@@ -0,0 +1,142 @@
+#include "registerBatcher.h"
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <unordered_set>
+
+static const char* INSERT_PREFIX =
+    "INSERT INTO user_info (name, password) VALUES ";
+
+RegisterBatcher::~RegisterBatcher() {
+    if (m_timerfd != -1)
+        close(m_timerfd);
+}
+
+bool RegisterBatcher::init(AsyncDB* async_db, int batch_size, int window_ms) {
+    m_async_db = async_db;
+    m_batch_size = batch_size > 0 ? batch_size : 1;
+    m_window_ms = window_ms > 0 ? window_ms : 1;
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerfd == -1) {
+        LOG("批量提交定时器创建失败");
+        return false;
+    }
+    return available();
+}
+
+void RegisterBatcher::arm_timer(int ms) {
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (long)(ms % 1000) * 1000000;
+    timerfd_settime(m_timerfd, 0, &spec, nullptr);
+}
+
+// 批次的第一条注册启动窗口定时器，攒满一批时由当前线程直接提交
+bool RegisterBatcher::submit(const string& name,
+                             const string& password,
+                             reg_callback cb) {
+    if (!available()) {
+        return false;
+    }
+    std::vector<reg_entry> rows;
+    m_lock.lock();
+    m_pending.push_back(reg_entry{name, password, std::move(cb)});
+    if (m_pending.size() == 1 && m_batch_size > 1) {
+        arm_timer(m_window_ms);
+    }
+    if ((int)m_pending.size() >= m_batch_size) {
+        rows.swap(m_pending);
+        arm_timer(0);
+    }
+    m_lock.unlock();
+    if (!rows.empty()) {
+        flush(rows);
+    }
+    return true;
+}
+
+void RegisterBatcher::on_timer() {
+    uint64_t cnt;
+    read(m_timerfd, &cnt, sizeof(cnt));
+    std::vector<reg_entry> rows;
+    m_lock.lock();
+    rows.swap(m_pending);
+    m_lock.unlock();
+    if (!rows.empty()) {
+        flush(rows);
+    }
+}
+
+string RegisterBatcher::values(const reg_entry& entry) {
+    // 密码是MD5的十六进制串，只有用户名需要转义
+    return "('" + m_async_db->escape(entry.name) + "', '" + entry.password +
+           "')";
+}
+
+// 合并成一条多行INSERT，批次内重名的行不写入，完成时直接判为重名
+void RegisterBatcher::flush(std::vector<reg_entry>& rows) {
+    std::shared_ptr<reg_batch> batch = std::make_shared<reg_batch>();
+    batch->rows.swap(rows);
+    batch->dup.assign(batch->rows.size(), 0);
+    std::unordered_set<string> names;
+    string sql(INSERT_PREFIX);
+    bool first = true;
+    for (size_t i = 0; i < batch->rows.size(); ++i) {
+        if (!names.insert(batch->rows[i].name).second) {
+            batch->dup[i] = 1;
+            continue;
+        }
+        if (!first) {
+            sql += ", ";
+        }
+        sql += values(batch->rows[i]);
+        first = false;
+    }
+    auto on_done = [this, batch](bool ok, unsigned int err, MYSQL_RES*) {
+        on_batch_done(batch, ok, err);
+    };
+    if (!m_async_db->submit(sql, on_done)) {
+        // 异步队列已满，整批失败；flush可能在工作线程中调用，失败也要回到主线程通知
+        m_async_db->fail_later(on_done);
+    }
+}
+
+// 批次完成（主线程）：成功则全部成功；重名则逐条重试；其他错误整批失败
+void RegisterBatcher::on_batch_done(std::shared_ptr<reg_batch> batch,
+                                    bool ok,
+                                    unsigned int err) {
+    size_t unique = 0;
+    for (char d : batch->dup) {
+        unique += !d;
+    }
+    if (ok) {
+        ++m_commits;
+        m_rows += unique;
+    }
+    for (size_t i = 0; i < batch->rows.size(); ++i) {
+        reg_entry& entry = batch->rows[i];
+        if (batch->dup[i]) {
+            entry.cb(false, ER_DUP_ENTRY);
+        } else if (ok) {
+            entry.cb(true, 0);
+        } else if (err == ER_DUP_ENTRY && unique > 1) {
+            insert_one(entry);
+        } else {
+            entry.cb(false, err);
+        }
+    }
+}
+
+void RegisterBatcher::insert_one(reg_entry& entry) {
+    reg_callback cb = std::move(entry.cb);
+    auto on_done = [this, cb](bool ok, unsigned int err, MYSQL_RES*) {
+        if (ok) {
+            ++m_commits;
+            ++m_rows;
+        }
+        cb(ok, err);
+    };
+    if (!m_async_db->submit(INSERT_PREFIX + values(entry), on_done)) {
+        m_async_db->fail_later(on_done);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef REGISTERBATCHER_H
+#define REGISTERBATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../locker/locker.h"
+#include "asyncDB.h"
+
+using std::string;
+
+/*
+    注册写入的批量提交（group commit）
+    注册请求先进入待提交队列，攒够batch_size条或者等待超过window_ms毫秒后，
+    合并成一条多行INSERT交给AsyncDB执行。单条语句在InnoDB中是一个完整的事务，
+    整批只需要一次提交；出现重名（ER_DUP_ENTRY）时整条语句回滚，再逐条重试以确定每一行的结果。
+    所有回调都在主线程中执行，与AsyncDB的回调保持一致。
+*/
+
+// 单个注册的结果，ok为false时err为MySQL错误码，重名为ER_DUP_ENTRY
+typedef std::function<void(bool ok, unsigned int err)> reg_callback;
+
+class RegisterBatcher {
+   public:
+    static RegisterBatcher* get_instance() {
+        static RegisterBatcher batcher;
+        return &batcher;
+    }
+
+    // 依赖已经初始化好的AsyncDB，batch_size为每批最大行数，window_ms为最长等待时间
+    bool init(AsyncDB* async_db, int batch_size, int window_ms);
+    bool available() const { return m_async_db && m_async_db->available(); }
+    // 批量窗口的定时器，需要加入主循环的epoll中
+    int get_fd() const { return m_timerfd; }
+    // 提交一条注册，任意线程均可调用
+    bool submit(const string& name, const string& password, reg_callback cb);
+    // 主循环在get_fd()可读时调用，提交窗口内攒下的注册
+    void on_timer();
+
+    // 统计：已提交的事务数、成功写入的行数
+    long long commit_count() const { return m_commits.load(); }
+    long long row_count() const { return m_rows.load(); }
+
+   private:
+    struct reg_entry {
+        string name;
+        string password;
+        reg_callback cb;
+    };
+    // 一个批次，dup[i]为true表示第i行与批次内前面的行重名
+    struct reg_batch {
+        std::vector<reg_entry> rows;
+        std::vector<char> dup;
+    };
+
+    RegisterBatcher()
+        : m_async_db(nullptr),
+          m_timerfd(-1),
+          m_batch_size(64),
+          m_window_ms(2),
+          m_commits(0),
+          m_rows(0) {}
+    ~RegisterBatcher();
+    void arm_timer(int ms);                  // 设置定时器，ms为0时取消
+    void flush(std::vector<reg_entry>& rows);  // 把一批注册合并提交
+    void on_batch_done(std::shared_ptr<reg_batch> batch,
+                       bool ok,
+                       unsigned int err);
+    void insert_one(reg_entry& entry);  // 逐条重试时单独插入一行
+    string values(const reg_entry& entry);  // 生成一行VALUES
+
+    AsyncDB* m_async_db;
+    int m_timerfd;
+    int m_batch_size;
+    int m_window_ms;
+    std::vector<reg_entry> m_pending;  // 待提交的注册
+    locker m_lock;                     // 保护m_pending
+    std::atomic<long long> m_commits;
+    std::atomic<long long> m_rows;
+};
+
+#endif
@@ -1,6 +1,12 @@
+#include <sys/epoll.h>
 #include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "asyncDB.h"
 #include "connection.h"
 #include "connectionPool.h"
+#include "registerBatcher.h"
 
 using std::cin;
 using std::cout;
@@ -9,6 +15,15 @@ using std::string;
 
 // #define press_single
 #define press_fout_thread
+// #define press_register
+// #define press_acquire
+
+// 毫秒级的单调时间，用于压测计时
+static double now_ms() {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
 
 int main() {
     // 单线程测试
@@ -121,6 +136,112 @@ int main() {
 
     cout << clock() - begin << "ms" << endl;
 
+#endif
+#ifdef press_register
+    // 注册突发压测：同样数量的注册，对比逐条自动提交与批量提交
+    // 需要user_info的name上有唯一索引，运行前先删除以bench_开头的用户
+    const int reg_threads = 8;
+    const int reg_per_thread = 1000;
+    const int reg_total = reg_threads * reg_per_thread;
+    ConnectionPool* reg_pool = ConnectionPool::get_pool();
+    std::vector<thread> workers;
+
+    // 1. 逐条提交：每个注册取一条连接，执行一次自动提交的INSERT
+    double start = now_ms();
+    for (int t = 0; t < reg_threads; ++t) {
+        workers.emplace_back([reg_pool, reg_per_thread, t]() {
+            for (int i = 0; i < reg_per_thread; ++i) {
+                std::shared_ptr<Connection> p = reg_pool->get_connection();
+                p->execute(
+                    "INSERT INTO user_info (name, password) VALUES (?, ?)",
+                    {"bench_a_" + std::to_string(t) + "_" + std::to_string(i),
+                     "password"});
+            }
+        });
+    }
+    for (thread& w : workers) {
+        w.join();
+    }
+    double single_ms = now_ms() - start;
+    printf("逐条提交：%d行 %d次提交 %.0f行/秒 %.0f提交/秒\n", reg_total,
+           reg_total, reg_total * 1000.0 / single_ms,
+           reg_total * 1000.0 / single_ms);
+
+    // 2. 批量提交：主线程充当事件循环，驱动AsyncDB与批量窗口定时器
+    AsyncDB* async_db = AsyncDB::get_instance();
+    RegisterBatcher* batcher = RegisterBatcher::get_instance();
+    if (!async_db->init(reg_pool) ||
+        !batcher->init(async_db, reg_pool->get_batch_size(),
+                       reg_pool->get_batch_window())) {
+        printf("异步查询初始化失败\n");
+        return 1;
+    }
+    int loop = epoll_create(5);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = async_db->get_fd();
+    epoll_ctl(loop, EPOLL_CTL_ADD, ev.data.fd, &ev);
+    ev.data.fd = batcher->get_fd();
+    epoll_ctl(loop, EPOLL_CTL_ADD, ev.data.fd, &ev);
+
+    std::atomic<int> done(0);
+    workers.clear();
+    start = now_ms();
+    for (int t = 0; t < reg_threads; ++t) {
+        workers.emplace_back([batcher, reg_per_thread, t, &done]() {
+            for (int i = 0; i < reg_per_thread; ++i) {
+                batcher->submit(
+                    "bench_b_" + std::to_string(t) + "_" + std::to_string(i),
+                    "password", [&done](bool, unsigned int) { ++done; });
+            }
+        });
+    }
+    while (done < reg_total) {
+        epoll_event events[2];
+        int number = epoll_wait(loop, events, 2, 100);
+        for (int i = 0; i < number; ++i) {
+            if (events[i].data.fd == async_db->get_fd()) {
+                async_db->dispatch();
+            } else {
+                batcher->on_timer();
+            }
+        }
+    }
+    for (thread& w : workers) {
+        w.join();
+    }
+    double batch_ms = now_ms() - start;
+    printf("批量提交：%d行 %lld次提交 %.0f行/秒 %.0f提交/秒\n", reg_total,
+           batcher->commit_count(), reg_total * 1000.0 / batch_ms,
+           batcher->commit_count() * 1000.0 / batch_ms);
+    close(loop);
+#endif
+#ifdef press_acquire
+    // 取/还连接的延迟压测：8~32个线程反复获取并立即归还连接，
+    // 分别在关闭与开启线程私有缓存时测量单次取还的平均耗时
+    ConnectionPool* acq_pool = ConnectionPool::get_pool();
+    const int acq_rounds = 100000;
+    for (int cache_size : {0, 2}) {
+        acq_pool->set_thread_cache_size(cache_size);
+        for (int threads : {8, 16, 32}) {
+            std::vector<thread> acq_workers;
+            double acq_start = now_ms();
+            for (int t = 0; t < threads; ++t) {
+                acq_workers.emplace_back([acq_pool, acq_rounds]() {
+                    for (int i = 0; i < acq_rounds; ++i) {
+                        std::shared_ptr<Connection> p =
+                            acq_pool->get_connection();
+                    }
+                });
+            }
+            for (thread& w : acq_workers) {
+                w.join();
+            }
+            double cost = now_ms() - acq_start;
+            printf("线程缓存%d 线程数%d：平均每次取还 %.0fns\n", cache_size,
+                   threads, cost * 1e6 / ((double)threads * acq_rounds));
+        }
+    }
 #endif
     printf("结束\n");
     return 0;
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "user_cache.h"
+
+using namespace std;
+
+// 编译（press_concurrent建议配合ThreadSanitizer检查数据竞争）：
+// g++ -std=c++17 -g -O1 -fsanitize=thread test.cpp user_cache.cpp -pthread -o test
+// g++ -std=c++17 -O2 test.cpp user_cache.cpp -pthread -o test
+
+#define press_concurrent
+// #define press_lookup
+// #define press_snapshot  // 运行两次：第一次生成快照，第二次映射快照并校验
+// #define press_lru
+
+// 构造一个32字符的十六进制串充当密码的MD5
+static string fake_md5(unsigned long long i) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", i * 0x9E3779B97F4A7C15ULL,
+             ~i);
+    return buf;
+}
+
+static double now_ms() {
+    return chrono::duration<double, milli>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 进程的常驻内存，单位字节
+static size_t rss_bytes() {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return (size_t)resident * 4096;
+}
+
+int main() {
+    UserCache* cache = UserCache::get_instance();
+#ifdef press_concurrent
+    // 并发压力测试：多个线程同时登录（读）和注册（写），检查结果是否正确
+    const int READERS = 8;        // 登录线程数
+    const int WRITERS = 4;        // 注册线程数
+    const int PRELOAD = 10000;    // 预先载入的用户数
+    const int PER_WRITER = 5000;  // 每个注册线程注册的用户数
+    const int PER_READER = 50000; // 每个登录线程的登录次数
+
+    for (int i = 0; i < PRELOAD; ++i) {
+        cache->insert("user" + to_string(i), fake_md5(i));
+    }
+
+    atomic<int> errors(0);
+    atomic<int> dup_ok(0);
+    vector<thread> threads;
+    for (int t = 0; t < WRITERS; ++t) {
+        threads.emplace_back([cache, t, &errors, &dup_ok]() {
+            for (int i = 0; i < PER_WRITER; ++i) {
+                string name = "new" + to_string(t) + "_" + to_string(i);
+                if (!cache->insert_if_absent(name, fake_md5(i))) {
+                    ++errors;
+                }
+                // 所有注册线程争抢同一批名字，每个名字只能有一个线程成功
+                if (cache->insert_if_absent("race" + to_string(i),
+                                            fake_md5(t))) {
+                    ++dup_ok;
+                }
+            }
+        });
+    }
+    for (int t = 0; t < READERS; ++t) {
+        threads.emplace_back([cache, t, &errors]() {
+            for (int i = 0; i < PER_READER; ++i) {
+                int id = (i * 7919 + t) % PRELOAD;
+                string name = "user" + to_string(id);
+                if (!cache->check(name, fake_md5(id))) {
+                    ++errors;
+                }
+                if (cache->check(name, fake_md5(id + 1))) {
+                    ++errors;
+                }
+                string password;
+                cache->find("new0_" + to_string(i % PER_WRITER), password);
+                if (!password.empty() &&
+                    password != fake_md5(i % PER_WRITER)) {
+                    ++errors;
+                }
+            }
+        });
+    }
+    for (thread& th : threads) {
+        th.join();
+    }
+    // 非法的MD5不会写入
+    if (cache->insert("bad", "not-a-md5") || cache->contains("bad")) {
+        ++errors;
+    }
+
+    size_t expect = PRELOAD + WRITERS * PER_WRITER + PER_WRITER;
+    printf("users: %zu (expect %zu)\n", cache->size(), expect);
+    printf("race winners: %d (expect %d)\n", dup_ok.load(), PER_WRITER);
+    printf("errors: %d\n", errors.load());
+    bool ok = errors == 0 && dup_ok == PER_WRITER && cache->size() == expect;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+#endif
+#ifdef press_lookup
+    // 内存占用与登录查找的耗时，分别在100万和1000万用户时测量
+    const int LOOKUPS = 2000000;
+    const int LEVELS[] = {1000000, 10000000};
+
+    // 对照：原来的unordered_map<string, string>，只测100万用户的内存
+    {
+        size_t before = rss_bytes();
+        unordered_map<string, string>* old_map =
+            new unordered_map<string, string>;
+        for (int i = 0; i < LEVELS[0]; ++i) {
+            (*old_map)["user" + to_string(i)] = fake_md5(i);
+        }
+        printf("unordered_map %d users: %.1f bytes/user (rss)\n", LEVELS[0],
+               (double)(rss_bytes() - before) / LEVELS[0]);
+        delete old_map;
+    }
+
+    int loaded = 0;
+    for (int level : LEVELS) {
+        for (; loaded < level; ++loaded) {
+            cache->insert("user" + to_string(loaded), fake_md5(loaded));
+        }
+        printf("UserCache %d users: %.1f bytes/user\n", level,
+               (double)cache->memory_usage() / level);
+
+        // 预先生成查询用的名字和摘要，只计查找本身的耗时
+        vector<string> names(LOOKUPS);
+        vector<string> pwds(LOOKUPS);
+        unsigned long long x = 88172645463325252ULL;
+        for (int i = 0; i < LOOKUPS; ++i) {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            int id = (int)(x % level);
+            names[i] = "user" + to_string(id);
+            pwds[i] = fake_md5(id);
+        }
+        int hit = 0;
+        double start = now_ms();
+        for (int i = 0; i < LOOKUPS; ++i) {
+            hit += cache->check(names[i], pwds[i]);
+        }
+        double cost = now_ms() - start;
+        printf("  check hit: %.1f ns/op (%d/%d)\n", cost * 1e6 / LOOKUPS, hit,
+               LOOKUPS);
+
+        for (int i = 0; i < LOOKUPS; ++i) {
+            names[i][0] = 'x';
+        }
+        hit = 0;
+        start = now_ms();
+        for (int i = 0; i < LOOKUPS; ++i) {
+            hit += cache->contains(names[i]);
+        }
+        cost = now_ms() - start;
+        printf("  lookup miss: %.1f ns/op (%d hit)\n", cost * 1e6 / LOOKUPS,
+               hit);
+    }
+    return 0;
+#endif
+#ifdef press_snapshot
+    const char* path = "./test_cache.snap";
+    const int USERS = 1000000;
+    uint64_t high_water = 0;
+    // 损坏的快照必须被拒绝（之后走冷启动），而不是在第一次查找时越界：
+    // 在快照的副本上把第一个占用槽位的name_off改到名字区之外，或者把cap改成乘法会溢出的值
+    // 偏移按user_cache.cpp中的布局：40字节的头部之后是各分片的{slots_off, cap, ...}
+    FILE* fp = fopen(path, "rb");
+    if (fp) {
+        vector<char> snap;
+        char buf[1 << 16];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            snap.insert(snap.end(), buf, buf + n);
+        }
+        fclose(fp);
+        uint64_t slots_off, cap;
+        memcpy(&slots_off, &snap[40], 8);
+        memcpy(&cap, &snap[48], 8);
+        int rejected = 0;
+        for (int kind = 0; kind < 2; ++kind) {
+            vector<char> bad = snap;
+            if (kind == 0) {
+                for (uint64_t j = 0; j < cap; ++j) {
+                    char* e = &bad[slots_off + j * 32];
+                    uint32_t hash;
+                    memcpy(&hash, e, 4);
+                    if (hash) {
+                        uint32_t off = 0xFFFFFF00u;
+                        memcpy(e + 4, &off, 4);
+                        break;
+                    }
+                }
+            } else {
+                uint64_t huge = 1ULL << 59;  // huge * 32回绕为0
+                memcpy(&bad[48], &huge, 8);
+            }
+            const char* bad_path = "./test_cache_bad.snap";
+            FILE* out = fopen(bad_path, "wb");
+            fwrite(bad.data(), 1, bad.size(), out);
+            fclose(out);
+            uint64_t hw = 0;
+            rejected += !cache->load(bad_path, hw);
+            unlink(bad_path);
+        }
+        printf("corrupt snapshots rejected: %d (expect 2)\n", rejected);
+        if (rejected != 2) {
+            return 1;
+        }
+    }
+    double start = now_ms();
+    if (!cache->load(path, high_water)) {
+        for (int i = 0; i < USERS; ++i) {
+            cache->insert("user" + to_string(i), fake_md5(i));
+        }
+        printf("insert %d users: %.1f ms\n", USERS, now_ms() - start);
+        start = now_ms();
+        bool ok = cache->save(path, USERS);
+        printf("save: %s, %.1f ms\n", ok ? "ok" : "failed", now_ms() - start);
+        printf("run again to load the snapshot\n");
+        return ok ? 0 : 1;
+    }
+    printf("load: %.3f ms, %zu users, high water %llu\n", now_ms() - start,
+           cache->size(), (unsigned long long)high_water);
+    int errors = 0;
+    start = now_ms();
+    for (int i = 0; i < USERS; ++i) {
+        if (!cache->check("user" + to_string(i), fake_md5(i))) {
+            ++errors;
+        }
+    }
+    printf("check all (first touch): %.1f ms\n", now_ms() - start);
+    // 写入会把分片从快照复制到堆上，之后快照中的用户仍然可查
+    cache->insert("new_user", fake_md5(1));
+    if (!cache->check("new_user", fake_md5(1)) ||
+        !cache->check("user0", fake_md5(0)) || cache->contains("nobody")) {
+        ++errors;
+    }
+    printf("size %zu, errors %d\n", cache->size(), errors);
+    printf("%s\n", errors == 0 ? "PASS" : "FAIL");
+    return errors == 0 ? 0 : 1;
+#endif
+#ifdef press_lru
+    // 容量受限模式：模拟10万用户的数据库，缓存只放1000个条目
+    const int DB_USERS = 100000;
+    const int CAPACITY = 1000;
+    atomic<int> loads(0);
+    cache->set_capacity(CAPACITY, 60);
+    cache->set_loader([&loads](const string& name, string& password) {
+        ++loads;
+        usleep(2000);  // 模拟一次数据库往返
+        if (name.compare(0, 4, "user") != 0) {
+            return 0;
+        }
+        int id = atoi(name.c_str() + 4);
+        if (id >= DB_USERS) {
+            return 0;
+        }
+        password = fake_md5(id);
+        return 1;
+    });
+    auto digest = [](int id, uint8_t* out) {
+        string hex = fake_md5(id);
+        for (int i = 0; i < 16; ++i) {
+            out[i] = (uint8_t)stoi(hex.substr(2 * i, 2), nullptr, 16);
+        }
+    };
+    int errors = 0;
+    uint8_t d[16];
+
+    // 16个线程同时登录同一个冷用户，只应查询一次数据库
+    vector<thread> threads;
+    atomic<int> ok_count(0);
+    for (int t = 0; t < 16; ++t) {
+        threads.emplace_back([&]() {
+            uint8_t mine[16];
+            digest(42, mine);
+            ok_count += cache->verify("user42", mine) == UserCache::VERIFY_OK;
+        });
+    }
+    for (thread& th : threads) {
+        th.join();
+    }
+    printf("single-flight: %d logins ok, %d loads (expect 16, 1)\n",
+           ok_count.load(), loads.load());
+    errors += ok_count != 16 || loads != 1;
+
+    // 不存在的用户第二次走负缓存，错误的密码直接在缓存中判定
+    loads = 0;
+    digest(1, d);
+    errors += cache->verify("nobody", d) != UserCache::VERIFY_FAIL;
+    errors += cache->verify("nobody", d) != UserCache::VERIFY_FAIL;
+    errors += cache->verify("user42", d) != UserCache::VERIFY_FAIL;
+    printf("negative: %d loads (expect 1)\n", loads.load());
+    errors += loads != 1;
+    // 注册会覆盖负缓存
+    cache->insert("nobody", fake_md5(1));
+    errors += cache->verify("nobody", d) != UserCache::VERIFY_OK;
+
+    // 登录大量不同的用户，缓存大小不超过容量，热点用户保持命中
+    for (int i = 0; i < 5000; ++i) {
+        digest(i * 17 % DB_USERS, d);
+        errors += cache->verify("user" + to_string(i * 17 % DB_USERS), d) !=
+                  UserCache::VERIFY_OK;
+        digest(7, d);
+        errors += cache->verify("user7", d) != UserCache::VERIFY_OK;
+    }
+    printf("size %zu (capacity %d), memory %zu bytes\n", cache->size(),
+           CAPACITY, cache->memory_usage());
+    errors += cache->size() > (size_t)CAPACITY + UserCache::SHARD_NUM;
+
+    loads = 0;
+    const int HITS = 1000000;
+    digest(7, d);
+    double start = now_ms();
+    for (int i = 0; i < HITS; ++i) {
+        errors += cache->verify("user7", d) != UserCache::VERIFY_OK;
+    }
+    printf("hot hit: %.1f ns/op, %d loads\n",
+           (now_ms() - start) * 1e6 / HITS, loads.load());
+    errors += loads != 0;
+    printf("errors %d\n%s\n", errors, errors == 0 ? "PASS" : "FAIL");
+    return errors == 0 ? 0 : 1;
+#endif
+}
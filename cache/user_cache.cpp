@@ -0,0 +1,595 @@
+#include "user_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+
+/*
+    快照文件格式，所有整数按本机字节序：
+    snap_header | snap_shard[SHARD_NUM] | 各分片的槽位表和名字区（起始位置按64字节对齐）
+    槽位表与内存中的slot数组逐字节相同，映射后可以直接查找
+*/
+static const char SNAP_MAGIC[8] = {'U', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+static const uint32_t SNAP_VERSION = 1;
+static const uint64_t SNAP_ALIGN = 64;
+
+struct snap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t shard_num;
+    uint64_t high_water;  // 快照包含的数据库最大id
+    uint64_t count;       // 用户总数
+    uint64_t file_len;    // 文件总长度，用来发现写了一半的文件
+};
+
+struct snap_shard {
+    uint64_t slots_off;
+    uint64_t cap;
+    uint64_t names_off;
+    uint64_t names_len;
+    uint64_t count;
+};
+
+static const char HEX[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// 32个字符的十六进制MD5转成16字节
+static bool from_hex(const string& hex, uint8_t* digest) {
+    if (hex.size() != 32) {
+        return false;
+    }
+    for (int i = 0; i < 16; ++i) {
+        int hi = hex_value(hex[2 * i]), lo = hex_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static string to_hex(const uint8_t* digest) {
+    string hex(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        hex[2 * i] = HEX[digest[i] >> 4];
+        hex[2 * i + 1] = HEX[digest[i] & 0xf];
+    }
+    return hex;
+}
+
+const UserCache::slot* UserCache::lookup(const shard& s,
+                                         std::string_view name,
+                                         uint32_t hv) {
+    if (s.cap == 0) {
+        return nullptr;
+    }
+    size_t mask = s.cap - 1;
+    for (size_t i = hv & mask;; i = (i + 1) & mask) {
+        const slot& e = s.table[i];
+        if (e.hash == 0) {
+            return nullptr;
+        }
+        if (e.hash == hv && e.name_len == name.size() &&
+            memcmp(s.arena + e.name_off, name.data(), name.size()) == 0) {
+            return &e;
+        }
+    }
+}
+
+void UserCache::sync(shard& s) {
+    s.table = s.slots.data();
+    s.cap = s.slots.size();
+    s.arena = s.names.data();
+    s.arena_len = s.names.size();
+}
+
+void UserCache::materialize(shard& s) {
+    s.slots.assign(s.table, s.table + s.cap);
+    s.names.assign(s.arena, s.arena + s.arena_len);
+    s.mapped = false;
+    sync(s);
+}
+
+// 容量翻倍，槽位里保存了哈希值，重新放置时不需要再计算用户名的哈希
+void UserCache::grow(shard& s) {
+    size_t cap = s.slots.empty() ? 16 : s.slots.size() * 2;
+    std::vector<slot> slots(cap);
+    size_t mask = cap - 1;
+    for (const slot& e : s.slots) {
+        if (e.hash == 0) {
+            continue;
+        }
+        size_t i = e.hash & mask;
+        while (slots[i].hash != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = e;
+    }
+    s.slots.swap(slots);
+    sync(s);
+}
+
+bool UserCache::put(shard& s,
+                    std::string_view name,
+                    uint32_t hv,
+                    const uint8_t* digest,
+                    bool overwrite,
+                    uint32_t flags) {
+    const slot* found = lookup(s, name, hv);
+    if (found && !overwrite && !(found->flags & SLOT_NEGATIVE)) {
+        return false;
+    }
+    if (s.mapped) {
+        size_t idx = found ? found - s.table : 0;
+        materialize(s);
+        found = found ? s.table + idx : nullptr;
+    }
+    if (found) {
+        slot& e = s.slots[found - s.table];
+        bool was_negative = e.flags & SLOT_NEGATIVE;
+        memcpy(e.digest, digest, 16);
+        e.flags = flags;
+        return was_negative;
+    }
+    if (m_shard_limit && s.count >= m_shard_limit) {
+        evict(s);
+    }
+    if ((s.count + 1) * 4 > s.slots.size() * 3) {
+        grow(s);
+    }
+    size_t mask = s.slots.size() - 1;
+    size_t i = hv & mask;
+    while (s.slots[i].hash != 0) {
+        i = (i + 1) & mask;
+    }
+    slot& n = s.slots[i];
+    n.hash = hv;
+    n.name_off = (uint32_t)s.names.size();
+    n.name_len = (uint32_t)name.size();
+    n.flags = flags;
+    memcpy(n.digest, digest, 16);
+    s.names.insert(s.names.end(), name.begin(), name.end());
+    ++s.count;
+    sync(s);
+    return true;
+}
+
+// 线性探测的删除：把后面探测链上的条目往前移，保证查找不会提前遇到空槽
+void UserCache::erase(shard& s, size_t i) {
+    size_t mask = s.slots.size() - 1;
+    s.garbage += s.slots[i].name_len;
+    for (size_t j = (i + 1) & mask; s.slots[j].hash != 0; j = (j + 1) & mask) {
+        size_t home = s.slots[j].hash & mask;
+        // home不在(i, j]区间内时，j上的条目可以移到i
+        bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            s.slots[i] = s.slots[j];
+            i = j;
+        }
+    }
+    memset(&s.slots[i], 0, sizeof(slot));
+    --s.count;
+}
+
+// CLOCK：访问位为1的条目清零后跳过，遇到访问位为0或已过期的负缓存时淘汰
+void UserCache::evict(shard& s) {
+    size_t mask = s.slots.size() - 1;
+    int64_t now = now_ms();
+    for (;;) {
+        size_t i = s.hand;
+        s.hand = (s.hand + 1) & mask;
+        slot& e = s.slots[i];
+        if (e.hash == 0) {
+            continue;
+        }
+        int64_t expire;
+        memcpy(&expire, e.digest, sizeof(expire));
+        bool expired = (e.flags & SLOT_NEGATIVE) && expire <= now;
+        if ((e.flags & SLOT_REF) && !expired) {
+            e.flags &= ~SLOT_REF;
+            continue;
+        }
+        erase(s, i);
+        break;
+    }
+    if (s.garbage > 4096 && s.garbage * 2 > s.names.size()) {
+        compact(s);
+    }
+    sync(s);
+}
+
+void UserCache::compact(shard& s) {
+    std::vector<char> names;
+    names.reserve(s.names.size() - s.garbage);
+    for (slot& e : s.slots) {
+        if (e.hash == 0) {
+            continue;
+        }
+        uint32_t off = (uint32_t)names.size();
+        names.insert(names.end(), s.names.begin() + e.name_off,
+                     s.names.begin() + e.name_off + e.name_len);
+        e.name_off = off;
+    }
+    s.names.swap(names);
+    s.garbage = 0;
+}
+
+bool UserCache::find(const string& name, string& password) {
+    uint64_t h = hash_name(name);
+    shard& s = get_shard(h);
+    s.lock.rdlock();
+    const slot* e = lookup(s, name, slot_hash(h));
+    bool found = e && !(load_flags(e) & SLOT_NEGATIVE);
+    if (found) {
+        password = to_hex(e->digest);
+    }
+    s.lock.unlock();
+    return found;
+}
+
+bool UserCache::contains(const string& name) {
+    uint64_t h = hash_name(name);
+    shard& s = get_shard(h);
+    s.lock.rdlock();
+    const slot* e = lookup(s, name, slot_hash(h));
+    bool found = e && !(load_flags(e) & SLOT_NEGATIVE);
+    s.lock.unlock();
+    return found;
+}
+
+bool UserCache::check(const string& name, const string& password) {
+    uint8_t digest[16];
+    if (!from_hex(password, digest)) {
+        return false;
+    }
+    return check(name, digest);
+}
+
+bool UserCache::check(const string& name, const uint8_t* digest) {
+    uint64_t h = hash_name(name);
+    shard& s = get_shard(h);
+    s.lock.rdlock();
+    const slot* e = lookup(s, name, slot_hash(h));
+    bool ok = e && !(load_flags(e) & SLOT_NEGATIVE) &&
+              memcmp(e->digest, digest, 16) == 0;
+    s.lock.unlock();
+    return ok;
+}
+
+bool UserCache::insert(const string& name, const string& password) {
+    uint8_t digest[16];
+    if (!from_hex(password, digest)) {
+        return false;
+    }
+    uint64_t h = hash_name(name);
+    shard& s = get_shard(h);
+    s.lock.wrlock();
+    put(s, name, slot_hash(h), digest, true);
+    s.lock.unlock();
+    return true;
+}
+
+bool UserCache::insert_if_absent(const string& name, const string& password) {
+    uint8_t digest[16];
+    if (!from_hex(password, digest)) {
+        return false;
+    }
+    uint64_t h = hash_name(name);
+    shard& s = get_shard(h);
+    s.lock.wrlock();
+    bool inserted = put(s, name, slot_hash(h), digest, false);
+    s.lock.unlock();
+    return inserted;
+}
+
+void UserCache::set_capacity(size_t capacity, int negative_ttl) {
+    m_shard_limit = capacity ? (capacity + SHARD_NUM - 1) / SHARD_NUM : 0;
+    m_negative_ttl = negative_ttl;
+}
+
+struct UserCache::flight {
+    locker lock;
+    cond cv;
+    bool done = false;
+    int ret = -1;
+    uint8_t digest[16];
+};
+
+// 命中时设置访问位；多个读者可能同时设置，使用原子操作，已经置位的不再写，避免缓存行来回失效
+bool UserCache::resolve(const slot* e,
+                        const uint8_t* digest,
+                        VERIFY_RESULT& result) {
+    uint32_t flags = load_flags(e);
+    if (flags & SLOT_NEGATIVE) {
+        int64_t expire;
+        memcpy(&expire, e->digest, sizeof(expire));
+        if (expire <= now_ms()) {
+            return false;
+        }
+        result = VERIFY_FAIL;
+    } else {
+        result = memcmp(e->digest, digest, 16) == 0 ? VERIFY_OK : VERIFY_FAIL;
+    }
+    if (m_shard_limit && !(flags & SLOT_REF)) {
+        __atomic_fetch_or(const_cast<uint32_t*>(&e->flags), SLOT_REF,
+                          __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+UserCache::VERIFY_RESULT UserCache::verify(const string& name,
+                                           const uint8_t* digest) {
+    uint64_t h = hash_name(name);
+    uint32_t hv = slot_hash(h);
+    shard& s = get_shard(h);
+    VERIFY_RESULT result = VERIFY_FAIL;
+    s.lock.rdlock();
+    const slot* e = lookup(s, name, hv);
+    bool hit = e && resolve(e, digest, result);
+    s.lock.unlock();
+    if (hit || !m_shard_limit || !m_loader) {
+        // 不限容量时缓存就是完整的用户表，未命中即不存在
+        return result;
+    }
+    return load_user(s, name, hv, digest);
+}
+
+UserCache::VERIFY_RESULT UserCache::load_user(shard& s,
+                                              const string& name,
+                                              uint32_t hv,
+                                              const uint8_t* digest) {
+    VERIFY_RESULT result = VERIFY_FAIL;
+    std::shared_ptr<flight> f;
+    bool leader = false;
+    s.lock.wrlock();
+    // 加写锁之前可能已经有其他线程查询完成
+    const slot* e = lookup(s, name, hv);
+    if (e && resolve(e, digest, result)) {
+        s.lock.unlock();
+        return result;
+    }
+    auto it = s.flights.find(name);
+    if (it != s.flights.end()) {
+        f = it->second;
+    } else {
+        f = std::make_shared<flight>();
+        s.flights.emplace(name, f);
+        leader = true;
+    }
+    s.lock.unlock();
+
+    if (leader) {
+        string password;
+        uint8_t loaded[16] = {};
+        int ret = m_loader(name, password);
+        if (ret == 1 && !from_hex(password, loaded)) {
+            ret = 0;  // 数据库里的密码不是MD5，无法登录，按不存在处理
+        }
+        s.lock.wrlock();
+        if (ret == 1) {
+            // 查询期间新注册的用户已经写入，不覆盖
+            put(s, name, hv, loaded, false, SLOT_REF);
+        } else if (ret == 0) {
+            uint8_t expire[16] = {};
+            int64_t t = now_ms() + (int64_t)m_negative_ttl * 1000;
+            memcpy(expire, &t, sizeof(t));
+            put(s, name, hv, expire, false, SLOT_NEGATIVE);
+        }
+        s.flights.erase(name);
+        s.lock.unlock();
+        f->lock.lock();
+        f->ret = ret;
+        memcpy(f->digest, loaded, 16);
+        f->done = true;
+        f->cv.broadcast();
+        f->lock.unlock();
+    } else {
+        f->lock.lock();
+        while (!f->done) {
+            f->cv.wait(f->lock.get());
+        }
+        f->lock.unlock();
+    }
+    if (f->ret < 0) {
+        return VERIFY_ERROR;
+    }
+    if (f->ret == 0) {
+        return VERIFY_FAIL;
+    }
+    return memcmp(f->digest, digest, 16) == 0 ? VERIFY_OK : VERIFY_FAIL;
+}
+
+// 逐个分片加读锁统计，结果只是一个近似的快照
+size_t UserCache::size() {
+    size_t total = 0;
+    for (shard& s : m_shards) {
+        s.lock.rdlock();
+        total += s.count;
+        s.lock.unlock();
+    }
+    return total;
+}
+
+size_t UserCache::memory_usage() {
+    size_t total = sizeof(m_shards);
+    for (shard& s : m_shards) {
+        s.lock.rdlock();
+        if (s.mapped) {
+            total += s.cap * sizeof(slot) + s.arena_len;
+        } else {
+            total += s.slots.capacity() * sizeof(slot) + s.names.capacity();
+        }
+        s.lock.unlock();
+    }
+    return total;
+}
+
+UserCache::~UserCache() {
+    if (m_map) {
+        munmap(m_map, m_map_len);
+    }
+}
+
+static bool write_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 补零到SNAP_ALIGN的整数倍，off为当前的文件长度
+static bool write_pad(int fd, uint64_t& off) {
+    static const char zeros[SNAP_ALIGN] = {};
+    uint64_t pad = (SNAP_ALIGN - off % SNAP_ALIGN) % SNAP_ALIGN;
+    off += pad;
+    return write_all(fd, zeros, pad);
+}
+
+// 分片逐个加读锁写出，写快照期间只会短暂阻塞同一分片上的注册
+bool UserCache::save(const char* path, uint64_t high_water) {
+    string tmp = string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    snap_header header;
+    memcpy(header.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+    header.version = SNAP_VERSION;
+    header.shard_num = SHARD_NUM;
+    header.high_water = high_water;
+    header.count = 0;
+    snap_shard table[SHARD_NUM];
+    memset(table, 0, sizeof(table));
+    uint64_t off = sizeof(header) + sizeof(table);
+    // 头部最后再写，先占住位置
+    bool ok = lseek(fd, off, SEEK_SET) == (off_t)off && write_pad(fd, off);
+    for (int i = 0; ok && i < SHARD_NUM; ++i) {
+        shard& s = m_shards[i];
+        s.lock.rdlock();
+        snap_shard& t = table[i];
+        t.cap = s.cap;
+        t.count = s.count;
+        t.slots_off = off;
+        ok = write_all(fd, s.table, s.cap * sizeof(slot));
+        off += s.cap * sizeof(slot);
+        t.names_off = off;
+        t.names_len = s.arena_len;
+        ok = ok && write_all(fd, s.arena, s.arena_len);
+        off += s.arena_len;
+        s.lock.unlock();
+        header.count += t.count;
+        ok = ok && write_pad(fd, off);
+    }
+    header.file_len = off;
+    ok = ok && pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+         pwrite(fd, table, sizeof(table), sizeof(header)) == sizeof(table) &&
+         fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 校验头部、各分片的边界和每个占用槽位的用户名范围，名字区不读取，映射后按需缺页加载
+bool UserCache::load(const char* path, uint64_t& high_water) {
+    for (shard& s : m_shards) {
+        if (s.cap != 0 || m_map) {
+            return false;
+        }
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        (size_t)st.st_size < sizeof(snap_header) + sizeof(snap_shard) * SHARD_NUM) {
+        close(fd);
+        return false;
+    }
+    size_t len = st.st_size;
+    void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const char* base = (const char*)map;
+    const snap_header* header = (const snap_header*)base;
+    const snap_shard* table = (const snap_shard*)(base + sizeof(snap_header));
+    bool ok = memcmp(header->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) == 0 &&
+              header->version == SNAP_VERSION &&
+              header->shard_num == SHARD_NUM && header->file_len == len;
+    // 文件可能被截断或损坏，所有偏移和长度都按不会溢出的方式检查：先确认偏移在文件内，
+    // 再用剩余长度比较，避免构造的cap、长度相加或相乘后回绕
+    for (int i = 0; ok && i < SHARD_NUM; ++i) {
+        const snap_shard& t = table[i];
+        ok = (t.cap & (t.cap - 1)) == 0 && t.slots_off % SNAP_ALIGN == 0 &&
+             t.slots_off <= len && t.cap <= (len - t.slots_off) / sizeof(slot) &&
+             t.count <= t.cap && t.count * 4 <= t.cap * 3 &&
+             t.names_off <= len && t.names_len <= len - t.names_off;
+        // 每个占用的槽位引用的用户名都必须落在本分片的名字区内，查找时直接memcmp
+        const slot* slots = (const slot*)(base + t.slots_off);
+        uint64_t used = 0;
+        for (uint64_t j = 0; ok && j < t.cap; ++j) {
+            const slot& e = slots[j];
+            if (e.hash == 0) {
+                continue;
+            }
+            ++used;
+            ok = e.name_len <= t.names_len &&
+                 e.name_off <= t.names_len - e.name_len;
+        }
+        ok = ok && used == t.count;
+    }
+    if (!ok) {
+        munmap(map, len);
+        return false;
+    }
+    for (int i = 0; i < SHARD_NUM; ++i) {
+        shard& s = m_shards[i];
+        const snap_shard& t = table[i];
+        s.lock.wrlock();
+        if (t.cap) {
+            s.table = (const slot*)(base + t.slots_off);
+            s.cap = t.cap;
+            s.arena = base + t.names_off;
+            s.arena_len = t.names_len;
+            s.count = t.count;
+            s.mapped = true;
+        }
+        s.lock.unlock();
+    }
+    m_map = map;
+    m_map_len = len;
+    high_water = header->high_water;
+    return true;
+}
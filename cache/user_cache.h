@@ -0,0 +1,179 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../locker/locker.h"
+
+using std::string;
+
+/*
+    并发的用户凭据缓存（用户名 -> 密码的MD5）
+    按用户名的哈希分成SHARD_NUM个分片，每个分片由自己的读写锁保护：
+    1. 登录只读，只对一个分片加读锁，不同分片、同一分片的读者之间都不互斥
+    2. 注册写入只对一个分片加写锁，不影响其他分片上的登录
+    没有任何全局锁，取代原来无锁保护的http_conn::user_info
+
+    每个分片是一张开放寻址（线性探测）的扁平哈希表，面向百万级以上的用户：
+    1. 槽位定长32字节，两个槽位正好占半条缓存行，探测时顺序访问相邻内存
+    2. 密码以16字节的二进制MD5保存，不再保存32个字符的十六进制串
+    3. 用户名统一存放在分片的名字区（arena）中，槽位只记录偏移和长度，
+       没有逐个用户的堆分配，比较用户名前先比较保存的哈希值
+    用户只增不删，因此线性探测不需要墓碑
+
+    缓存可以整体保存为快照文件，文件内各分片的槽位表和名字区与内存中的布局完全相同：
+    启动时直接mmap快照即可开始服务，不需要逐条插入；分片第一次被写入时才复制到堆上。
+    快照同时记录高水位（已从数据库读到的最大id），启动后只需从数据库补读id更大的用户
+
+    容量受限（LRU）模式：用户太多放不下时只缓存一部分，缓存不再是完整的用户表
+    1. 每个分片最多容纳capacity/SHARD_NUM个条目，满了用CLOCK算法近似LRU淘汰，
+       命中时只设置槽位的访问位，读路径仍然只加读锁
+    2. 未命中时通过加载函数查询数据库并写入缓存，不存在的用户写入带过期时间的负缓存
+    3. 同一用户名并发未命中时只有第一个线程查询数据库，其余线程等待它的结果（single-flight）
+*/
+
+// 加载函数：查到用户返回1并把十六进制MD5写入password，用户不存在返回0，出错返回-1
+typedef std::function<int(const string& name, string& password)> user_loader;
+class UserCache {
+   public:
+    static UserCache* get_instance() {
+        static UserCache cache;
+        return &cache;
+    }
+
+    // 查找用户，找到时把密码（十六进制MD5）写入password
+    bool find(const string& name, string& password);
+    // 用户是否存在
+    bool contains(const string& name);
+    // 校验用户名和密码，password为十六进制MD5
+    bool check(const string& name, const string& password);
+    // 校验用户名和密码，digest为16字节的二进制MD5，登录时省去十六进制转换
+    bool check(const string& name, const uint8_t* digest);
+    // 写入或覆盖用户，password不是合法的十六进制MD5时返回false
+    bool insert(const string& name, const string& password);
+    // 用户不存在时写入，返回是否写入成功
+    bool insert_if_absent(const string& name, const string& password);
+    // 缓存的用户总数
+    size_t size();
+    // 缓存占用的内存（槽位表和名字区按已分配的容量计算，含映射的快照），单位字节
+    size_t memory_usage();
+
+    // 设置为容量受限模式，capacity为最多缓存的条目数（含负缓存），0表示不限；
+    // negative_ttl为负缓存的有效期，单位秒。需要在使用缓存前设置
+    void set_capacity(size_t capacity, int negative_ttl);
+    bool bounded() const { return m_shard_limit != 0; }
+    // 未命中时使用的加载函数，只在容量受限模式下使用，需要在使用缓存前设置
+    void set_loader(user_loader loader) { m_loader = std::move(loader); }
+
+    enum VERIFY_RESULT { VERIFY_OK = 0, VERIFY_FAIL, VERIFY_ERROR };
+    // 登录校验，容量受限模式下未命中时回源数据库；
+    // 返回VERIFY_ERROR表示数据库查询失败，无法判断
+    VERIFY_RESULT verify(const string& name, const uint8_t* digest);
+
+    // 把缓存保存为快照，先写临时文件再rename，high_water为已读到的数据库最大id
+    bool save(const char* path, uint64_t high_water);
+    // 映射快照文件，只能在缓存为空时调用，成功时通过high_water返回快照的高水位
+    bool load(const char* path, uint64_t& high_water);
+
+    static const int SHARD_NUM = 64;
+
+   private:
+    struct slot {
+        uint32_t hash;      // 用户名哈希的低32位，0表示空槽
+        uint32_t name_off;  // 用户名在名字区中的偏移
+        uint32_t name_len;  // 用户名长度
+        uint32_t flags;     // SLOT_REF、SLOT_NEGATIVE
+        uint8_t digest[16];  // 密码的二进制MD5，负缓存时前8字节为过期时间
+    };
+    static const uint32_t SLOT_REF = 1;       // CLOCK访问位，只在容量受限模式下使用
+    static const uint32_t SLOT_NEGATIVE = 2;  // 负缓存：用户不存在
+    // 读锁下其他读者可能正在设置访问位，标志位一律原子读取
+    static uint32_t load_flags(const slot* e) {
+        return __atomic_load_n(&e->flags, __ATOMIC_RELAXED);
+    }
+    static_assert(sizeof(slot) == 32, "slot must be 32 bytes");
+
+    struct flight;  // 一次进行中的数据库查询
+
+    // 每个分片独占缓存行，避免不同分片的锁之间伪共享
+    // table/arena是查找时使用的视图，指向下面的slots/names，或者指向映射的快照
+    struct alignas(64) shard {
+        rwlocker lock;
+        std::vector<slot> slots;  // 容量为2的幂，负载超过3/4时翻倍
+        std::vector<char> names;  // 名字区
+        const slot* table = nullptr;
+        size_t cap = 0;
+        const char* arena = nullptr;
+        size_t arena_len = 0;
+        size_t count = 0;
+        bool mapped = false;  // 视图是否指向快照
+        size_t hand = 0;      // CLOCK指针
+        size_t garbage = 0;   // 名字区中已淘汰条目占用的字节数
+        // 正在查询数据库的用户名，由分片的写锁保护
+        std::unordered_map<string, std::shared_ptr<flight>> flights;
+    };
+
+    UserCache()
+        : m_map(nullptr), m_map_len(0), m_shard_limit(0), m_negative_ttl(60) {}
+    ~UserCache();
+    UserCache(const UserCache&) = delete;
+    UserCache& operator=(const UserCache&) = delete;
+
+    // 哈希值会写进快照，不能依赖标准库的实现，使用固定的FNV-1a再做一次混合
+    static uint64_t hash_name(std::string_view name) {
+        uint64_t h = 14695981039346656037ULL;
+        for (unsigned char c : name) {
+            h = (h ^ c) * 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+    // 分片用哈希的高位，槽位用低位，两者互不相关
+    shard& get_shard(uint64_t h) { return m_shards[h >> 58]; }
+    static uint32_t slot_hash(uint64_t h) {
+        uint32_t v = (uint32_t)h;
+        return v ? v : 1;
+    }
+
+    // 在分片中查找，未找到返回nullptr，调用者需持有锁
+    static const slot* lookup(const shard& s, std::string_view name, uint32_t hv);
+    // 写入（调用者持有写锁），已存在时overwrite决定是否覆盖，返回是否新插入；
+    // 负缓存视为不存在，总是会被覆盖
+    bool put(shard& s,
+             std::string_view name,
+             uint32_t hv,
+             const uint8_t* digest,
+             bool overwrite,
+             uint32_t flags = 0);
+    // 解析命中的条目，返回true表示已有结论，结果写入result
+    bool resolve(const slot* e, const uint8_t* digest, VERIFY_RESULT& result);
+    // 查询数据库并写入缓存，同名的并发查询合并为一次
+    VERIFY_RESULT load_user(shard& s,
+                            const string& name,
+                            uint32_t hv,
+                            const uint8_t* digest);
+    static void grow(shard& s);
+    void evict(shard& s);            // CLOCK淘汰一个条目
+    static void erase(shard& s, size_t i);  // 删除槽位i，后面的条目向前移动
+    static void compact(shard& s);   // 回收名字区中已淘汰的名字
+    static void materialize(shard& s);  // 把映射的分片复制到堆上，之后才能写入
+    static void sync(shard& s);         // 写入后让视图重新指向slots/names
+
+    shard m_shards[SHARD_NUM];
+    void* m_map;  // 映射的快照，分片复制到堆上之前一直有效
+    size_t m_map_len;
+    size_t m_shard_limit;  // 每个分片的条目上限，0表示不限
+    int m_negative_ttl;
+    user_loader m_loader;
+};
+
+static_assert(UserCache::SHARD_NUM == 64, "get_shard takes the top 6 bits");
+
+#endif
@@ -0,0 +1,44 @@
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// 去掉首尾的空白和换行
+static string trim(const string& str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+bool Config::load(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        return false;
+    }
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), fp)) {
+        string line = trim(buf);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t idx = line.find('=');
+        if (idx == string::npos) {
+            continue;
+        }
+        m_items[trim(line.substr(0, idx))] = trim(line.substr(idx + 1));
+    }
+    fclose(fp);
+    return true;
+}
+
+string Config::get_string(const string& key, const string& def) const {
+    auto it = m_items.find(key);
+    return it == m_items.end() ? def : it->second;
+}
+
+int Config::get_int(const string& key, int def) const {
+    auto it = m_items.find(key);
+    return it == m_items.end() ? def : atoi(it->second.c_str());
+}
@@ -0,0 +1,33 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <unordered_map>
+
+using std::string;
+
+/*
+    服务器配置（server.conf），格式与mysql.conf相同：每行一个key=value，#开头为注释
+    只在启动时由主线程读取一次，之后只读，多线程访问不需要加锁
+*/
+class Config {
+   public:
+    static Config* get_instance() {
+        static Config config;
+        return &config;
+    }
+
+    // 读取配置文件，文件不存在时返回false，所有配置项使用默认值
+    bool load(const char* path);
+    string get_string(const string& key, const string& def) const;
+    int get_int(const string& key, int def) const;
+
+   private:
+    Config() {}
+    Config(const Config&) = delete;
+    Config& operator=(const Config&) = delete;
+
+    std::unordered_map<string, string> m_items;
+};
+
+#endif
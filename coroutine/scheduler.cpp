@@ -0,0 +1,152 @@
+#include "scheduler.h"
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// 单调时钟的毫秒数
+static long long now_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+Scheduler::~Scheduler() {
+    if (m_epollfd != -1) {
+        close(m_epollfd);
+    }
+    if (m_timerfd != -1) {
+        close(m_timerfd);
+    }
+}
+
+bool Scheduler::init(int io_threads) {
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_epollfd == -1 || m_timerfd == -1) {
+        return false;
+    }
+    for (int i = 0; i < io_threads; ++i) {
+        pthread_t tid;
+        if (pthread_create(&tid, nullptr, blocking_worker, this) != 0) {
+            return false;
+        }
+        pthread_detach(tid);
+    }
+    return true;
+}
+
+std::vector<int> Scheduler::event_fds() const {
+    return {m_epollfd, m_timerfd};
+}
+
+void Scheduler::on_event(int fd) {
+    if (fd == m_timerfd) {
+        on_timer();
+    } else if (fd == m_epollfd) {
+        on_io();
+    }
+}
+
+void Scheduler::arm_timer(long long deadline) {
+    itimerspec its = {};
+    its.it_value.tv_sec = deadline / 1000;
+    its.it_value.tv_nsec = deadline % 1000 * 1000000;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+void Scheduler::add_timer(int ms, waiter w) {
+    long long deadline = now_ms() + ms;
+    m_timer_lock.lock();
+    // 新的定时器比堆顶更早到期时才需要重新设置timerfd
+    bool earliest = m_timers.empty() || deadline < m_timers.top().deadline;
+    m_timers.push({deadline, w});
+    if (earliest) {
+        arm_timer(deadline);
+    }
+    m_timer_lock.unlock();
+}
+
+void Scheduler::on_timer() {
+    uint64_t expirations;
+    while (read(m_timerfd, &expirations, sizeof(expirations)) > 0) {
+    }
+    std::vector<waiter> expired;
+    long long now = now_ms();
+    m_timer_lock.lock();
+    while (!m_timers.empty() && m_timers.top().deadline <= now) {
+        expired.push_back(m_timers.top().w);
+        m_timers.pop();
+    }
+    if (!m_timers.empty()) {
+        arm_timer(m_timers.top().deadline);
+    }
+    m_timer_lock.unlock();
+    // 在锁外恢复，执行者可能直接在当前线程里添加新的定时器
+    for (waiter& w : expired) {
+        w.exec->resume_later(w.handle);
+    }
+}
+
+bool Scheduler::add_io(int fd, uint32_t events, uint32_t* revents, waiter w) {
+    io_entry* entry = new io_entry{fd, revents, w};
+    epoll_event ev;
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = entry;
+    if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        delete entry;
+        return false;
+    }
+    return true;
+}
+
+void Scheduler::on_io() {
+    epoll_event events[64];
+    int n;
+    while ((n = epoll_wait(m_epollfd, events, 64, 0)) > 0) {
+        for (int i = 0; i < n; ++i) {
+            io_entry* entry = (io_entry*)events[i].data.ptr;
+            // 每次等待单独注册，就绪后立即删除，fd关闭或复用时不会留下旧的注册
+            epoll_ctl(m_epollfd, EPOLL_CTL_DEL, entry->fd, nullptr);
+            *entry->revents = events[i].events;
+            waiter w = entry->w;
+            delete entry;
+            w.exec->resume_later(w.handle);
+        }
+    }
+}
+
+void Scheduler::add_blocking(std::function<void()> fn, waiter w) {
+    m_job_lock.lock();
+    m_jobs.push_back({std::move(fn), w});
+    m_job_lock.unlock();
+    m_job_sem.post();
+}
+
+void* Scheduler::blocking_worker(void* arg) {
+    Scheduler* scheduler = (Scheduler*)arg;
+    while (true) {
+        scheduler->m_job_sem.wait();
+        scheduler->m_job_lock.lock();
+        if (scheduler->m_jobs.empty()) {
+            scheduler->m_job_lock.unlock();
+            continue;
+        }
+        blocking_job job = std::move(scheduler->m_jobs.front());
+        scheduler->m_jobs.pop_front();
+        scheduler->m_job_lock.unlock();
+        job.fn();
+        job.w.exec->resume_later(job.w.handle);
+    }
+    return nullptr;
+}
+
+bool io_ready::await_suspend(std::coroutine_handle<> h) {
+    if (!Scheduler::get_instance()->add_io(m_fd, m_events, &m_revents,
+                                           {executor::current(), h})) {
+        m_revents = EPOLLERR;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,179 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <vector>
+#include "../locker/locker.h"
+
+/*
+    协程的执行者：协程挂起后等待的事件完成时，由执行者安排在哪个线程恢复
+    HTTP连接是一个执行者，它把自己重新投递到线程池，由工作线程恢复处理函数
+    执行者在恢复协程之前把自己设为当前线程的current，可等待对象挂起时据此记下由谁恢复
+*/
+class executor {
+   public:
+    virtual ~executor() {}
+    // 恢复h，可能在任意线程中调用，甚至可能在协程还没有完全挂起时调用
+    virtual void resume_later(std::coroutine_handle<> h) = 0;
+
+    static executor* current() { return t_current; }
+    static executor* set_current(executor* exec) {
+        executor* prev = t_current;
+        t_current = exec;
+        return prev;
+    }
+
+   private:
+    static inline thread_local executor* t_current = nullptr;
+};
+
+/*
+    协程的调度器，负责各种等待的事件源
+    1. 定时器：一个timerfd加一个按到期时间排序的小根堆，co_await sleep_for(ms)
+    2. socket就绪：一个内部的epoll，EPOLLONESHOT注册，co_await io_ready(fd, EPOLLIN)
+    3. 阻塞操作：几个专门的线程执行会阻塞的函数（打开文件、同步查询等），co_await run_blocking(fn)
+    timerfd与内部epoll交给主循环的epoll监听，主线程在其可读时调用on_event
+    事件完成后统一交给挂起时记下的执行者恢复，调度器本身不运行任何处理函数
+*/
+class Scheduler {
+   public:
+    // 挂起的协程以及恢复它的执行者
+    struct waiter {
+        executor* exec;
+        std::coroutine_handle<> handle;
+    };
+
+    static Scheduler* get_instance() {
+        static Scheduler scheduler;
+        return &scheduler;
+    }
+
+    // io_threads为执行阻塞操作的线程数
+    bool init(int io_threads);
+    // 需要加入主循环epoll的文件描述符
+    std::vector<int> event_fds() const;
+    // 主循环在event_fds()中的描述符可读时调用
+    void on_event(int fd);
+
+    // 以下由可等待对象调用
+    void add_timer(int ms, waiter w);
+    // 注册失败返回false，调用者不应挂起
+    bool add_io(int fd, uint32_t events, uint32_t* revents, waiter w);
+    void add_blocking(std::function<void()> fn, waiter w);
+
+   private:
+    struct timer_entry {
+        long long deadline;  // 单调时钟的毫秒数
+        waiter w;
+        bool operator>(const timer_entry& other) const {
+            return deadline > other.deadline;
+        }
+    };
+    struct io_entry {
+        int fd;
+        uint32_t* revents;
+        waiter w;
+    };
+    struct blocking_job {
+        std::function<void()> fn;
+        waiter w;
+    };
+
+    Scheduler() : m_epollfd(-1), m_timerfd(-1) {}
+    ~Scheduler();
+    void arm_timer(long long deadline);  // 定时器设置为deadline时到期
+    void on_timer();
+    void on_io();
+    static void* blocking_worker(void* arg);
+
+    int m_epollfd;
+    int m_timerfd;
+    std::priority_queue<timer_entry,
+                        std::vector<timer_entry>,
+                        std::greater<timer_entry>>
+        m_timers;
+    locker m_timer_lock;  // 保护m_timers，任意工作线程都可能添加定时器
+    std::deque<blocking_job> m_jobs;
+    locker m_job_lock;  // 保护m_jobs
+    sem m_job_sem;      // 待执行的阻塞操作数
+};
+
+// co_await sleep_for(ms)：挂起ms毫秒，不占用线程
+class sleep_for {
+   public:
+    explicit sleep_for(int ms) : m_ms(ms) {}
+    bool await_ready() const { return m_ms <= 0; }
+    void await_suspend(std::coroutine_handle<> h) {
+        Scheduler::get_instance()->add_timer(m_ms, {executor::current(), h});
+    }
+    void await_resume() {}
+
+   private:
+    int m_ms;
+};
+
+// co_await io_ready(fd, EPOLLIN)：等待fd就绪，返回就绪的事件，注册失败时返回EPOLLERR
+class io_ready {
+   public:
+    io_ready(int fd, uint32_t events) : m_fd(fd), m_events(events), m_revents(0) {}
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    uint32_t await_resume() const { return m_revents; }
+
+   private:
+    int m_fd;
+    uint32_t m_events;
+    uint32_t m_revents;
+};
+
+// co_await run_blocking(fn)：在阻塞操作线程中执行fn，执行完后恢复
+class run_blocking {
+   public:
+    explicit run_blocking(std::function<void()> fn) : m_fn(std::move(fn)) {}
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        Scheduler::get_instance()->add_blocking(std::move(m_fn),
+                                                {executor::current(), h});
+    }
+    void await_resume() {}
+
+   private:
+    std::function<void()> m_fn;
+};
+
+/*
+    把回调风格的异步接口包装成可等待对象，用于数据库查询等已有的异步操作
+    start接收一个完成回调，成功发起返回true，之后回调可以在任意线程中调用一次；
+    返回false表示操作没有发起，协程不挂起，co_await的结果为空
+*/
+template <typename T>
+class async_result {
+   public:
+    typedef std::function<void(T)> callback;
+    explicit async_result(std::function<bool(callback)> start)
+        : m_start(std::move(start)), m_started(false) {}
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> h) {
+        executor* exec = executor::current();
+        m_started = m_start([this, exec, h](T value) {
+            m_value = std::move(value);
+            exec->resume_later(h);
+        });
+        return m_started;
+    }
+    std::optional<T> await_resume() {
+        return m_started ? std::optional<T>(std::move(m_value)) : std::nullopt;
+    }
+
+   private:
+    std::function<bool(callback)> m_start;
+    bool m_started;
+    T m_value;
+};
+
+#endif
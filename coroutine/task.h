@@ -0,0 +1,105 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+/*
+    协程的返回类型task<T>
+    1. 惰性启动：创建后处于挂起状态，由调用者co_await或者由执行者resume启动
+    2. 一个task中co_await另一个task时，被等待的task结束后通过对称转移直接恢复等待者，
+       不经过调度器，调用链再深也不会增加栈的深度
+    3. 最外层的task由执行者（如HTTP连接）驱动：resume之后检查done，完成后用result取结果
+    处理函数中的异常没有地方可以交还，直接终止程序
+*/
+template <typename T = void>
+class task;
+
+namespace task_detail {
+
+// 所有promise公共的部分：惰性启动、结束时恢复等待者
+struct promise_base {
+    std::coroutine_handle<> continuation;  // 等待本task的协程，最外层为空
+
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T>
+struct promise_value : promise_base {
+    std::optional<T> value;
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T take() { return std::move(*value); }
+};
+
+template <>
+struct promise_value<void> : promise_base {
+    void return_void() {}
+    void take() {}
+};
+
+}  // namespace task_detail
+
+template <typename T>
+class task {
+   public:
+    struct promise_type : task_detail::promise_value<T> {
+        task get_return_object() {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    task() : m_handle(nullptr) {}
+    task(task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    explicit operator bool() const { return m_handle != nullptr; }
+    // 最外层的task由执行者驱动
+    std::coroutine_handle<> handle() const { return m_handle; }
+    bool done() const { return m_handle.done(); }
+    T result() { return m_handle.promise().take(); }
+
+    // 在另一个协程中co_await：启动本task，结束后恢复等待者
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        m_handle.promise().continuation = caller;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().take(); }
+
+   private:
+    explicit task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "scheduler.h"
+#include "task.h"
+
+using namespace std;
+
+// g++ -std=c++20 -O2 test.cpp scheduler.cpp -pthread -o test
+
+// #define press_resume
+
+// 测试用的执行者：resume_later把协程放进队列，由主循环恢复，相当于服务器中的工作线程
+class loop_executor : public executor {
+   public:
+    void resume_later(coroutine_handle<> h) override {
+        lock_guard<mutex> guard(m_lock);
+        m_ready.push_back(h);
+    }
+    // 运行t直到结束，期间把调度器的事件源交给epoll监听
+    template <typename T>
+    T run(task<T> t) {
+        Scheduler* scheduler = Scheduler::get_instance();
+        int epollfd = epoll_create(5);
+        for (int fd : scheduler->event_fds()) {
+            epoll_event event = {};
+            event.data.fd = fd;
+            event.events = EPOLLIN;
+            epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+        }
+        executor* prev = executor::set_current(this);
+        t.handle().resume();
+        while (!t.done()) {
+            coroutine_handle<> h;
+            {
+                lock_guard<mutex> guard(m_lock);
+                if (!m_ready.empty()) {
+                    h = m_ready.front();
+                    m_ready.pop_front();
+                }
+            }
+            if (h) {
+                h.resume();
+                continue;
+            }
+            epoll_event events[4];
+            int n = epoll_wait(epollfd, events, 4, 10);
+            for (int i = 0; i < n; ++i) {
+                scheduler->on_event(events[i].data.fd);
+            }
+        }
+        executor::set_current(prev);
+        close(epollfd);
+        return t.result();
+    }
+
+   private:
+    mutex m_lock;
+    deque<coroutine_handle<>> m_ready;
+};
+
+static long long elapsed_ms(chrono::steady_clock::time_point start) {
+    return chrono::duration_cast<chrono::milliseconds>(
+               chrono::steady_clock::now() - start)
+        .count();
+}
+
+task<int> add_one(int x) {
+    co_return x + 1;
+}
+
+// 1. 嵌套调用，子协程同步完成
+task<int> nested() {
+    int sum = 0;
+    for (int i = 0; i < 1000; ++i) {
+        sum += co_await add_one(i);
+    }
+    co_return sum;
+}
+
+// 2. 定时器，多个定时器按到期先后恢复
+task<long long> sleeping() {
+    auto start = chrono::steady_clock::now();
+    co_await sleep_for(0);
+    co_await sleep_for(50);
+    co_await sleep_for(20);
+    co_return elapsed_ms(start);
+}
+
+// 3. 等待管道可读，另一个线程稍后写入
+task<int> reading(int fd) {
+    uint32_t revents = co_await io_ready(fd, EPOLLIN);
+    if (!(revents & EPOLLIN)) {
+        co_return -1;
+    }
+    char c = 0;
+    co_return read(fd, &c, 1) == 1 ? c : -1;
+}
+
+// 4. 阻塞操作在专门的线程中执行，不占用执行者
+task<bool> blocking() {
+    thread::id caller = this_thread::get_id(), worker;
+    co_await run_blocking([&]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        worker = this_thread::get_id();
+    });
+    co_return worker != caller && this_thread::get_id() == caller;
+}
+
+// 5. 回调风格的接口：异步线程中完成、立即完成、没有发起
+task<bool> callbacks() {
+    optional<int> a = co_await async_result<int>([](function<void(int)> done) {
+        thread([done]() {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            done(42);
+        }).detach();
+        return true;
+    });
+    optional<int> b = co_await async_result<int>([](function<void(int)> done) {
+        done(7);
+        return true;
+    });
+    optional<int> c = co_await async_result<int>(
+        [](function<void(int)>) { return false; });
+    co_return a == 42 && b == 7 && !c;
+}
+
+#ifdef press_resume
+// 每次co_await都挂起并经过执行者恢复，测量一次挂起加恢复的开销
+task<int> ping(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        optional<int> v = co_await async_result<int>([i](function<void(int)> done) {
+            done(i & 1);
+            return true;
+        });
+        sum += *v;
+    }
+    co_return sum;
+}
+#endif
+
+int main() {
+    if (!Scheduler::get_instance()->init(2)) {
+        printf("scheduler init failed\n");
+        return 1;
+    }
+    loop_executor exec;
+    int errors = 0;
+
+    int sum = exec.run(nested());
+    printf("nested: %d\n", sum);
+    errors += sum != 500500;
+
+    long long ms = exec.run(sleeping());
+    printf("sleep_for: %lld ms\n", ms);
+    errors += ms < 65 || ms > 200;  // 定时器精度为毫秒
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+    thread writer([&]() {
+        this_thread::sleep_for(chrono::milliseconds(30));
+        write(fds[1], "x", 1);
+    });
+    int c = exec.run(reading(fds[0]));
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+    printf("io_ready: %c\n", c);
+    errors += c != 'x';
+
+    bool ok = exec.run(blocking());
+    printf("run_blocking: %s\n", ok ? "ok" : "wrong thread");
+    errors += !ok;
+
+    ok = exec.run(callbacks());
+    printf("async_result: %s\n", ok ? "ok" : "wrong value");
+    errors += !ok;
+
+#ifdef press_resume
+    const int N = 2000000;
+    auto start = chrono::steady_clock::now();
+    int odd = exec.run(ping(N));
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("suspend + resume: %.1f ns (%d)\n", sec * 1e9 / N, odd);
+#endif
+
+    printf(errors ? "FAILED\n" : "all passed\n");
+    return errors != 0;
+}
@@ -6,7 +6,10 @@ CREATE TABLE IF NOT EXISTS `user_info`(
    `password` VARCHAR(200) NOT NULL,
    `age` INT(11) DEFAULT NULL,
    `sex` ENUM('male', 'female', 'privary'),
-   PRIMARY KEY (`id`)
+   PRIMARY KEY (`id`),
+   UNIQUE KEY `uk_name` (`name`)
 ) ENGINE = InnoDB DEFAULT CHARSET = utf8;
+-- 批量注册依赖name上的唯一索引区分重名，已有的表执行：
+-- ALTER TABLE user_info ADD UNIQUE KEY `uk_name` (`name`);
 INSERT INTO user_info (name, password, age, sex) VALUES ('Tom', 'test_password', 10, 'male');
 INSERT INTO user_info (name, password, age, sex) VALUES ('Amy', 'test_password2', 11, 'female');
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "form.h"
+#include <string.h>
+
+// 十六进制字符的值，不是十六进制字符返回-1
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+int FormParser::decode(char* begin, char* end) {
+    // 快速路径：没有需要解码的字符，字段保持原样
+    char* r = begin;
+    while (r < end && *r != '%' && *r != '+') {
+        ++r;
+    }
+    // 从第一个需要解码的字符开始，读指针r始终不落后于写指针w
+    char* w = r;
+    while (r < end) {
+        if (*r == '+') {
+            *w++ = ' ';
+            ++r;
+        } else if (*r == '%') {
+            if (end - r < 3) {
+                return -1;
+            }
+            int hi = hex_value(r[1]), lo = hex_value(r[2]);
+            if (hi < 0 || lo < 0) {
+                return -1;
+            }
+            *w++ = (char)(hi << 4 | lo);
+            r += 3;
+        } else {
+            *w++ = *r++;
+        }
+    }
+    return w - begin;
+}
+
+bool FormParser::parse(char* body, int len) {
+    m_count = 0;
+    char* p = body;
+    char* end = body + len;
+    while (p < end) {
+        char* amp = (char*)memchr(p, '&', end - p);
+        char* seg_end = amp ? amp : end;
+        if (seg_end != p) {  // 跳过空字段，如a=1&&b=2
+            if (m_count == MAX_FIELDS) {
+                return false;
+            }
+            char* eq = (char*)memchr(p, '=', seg_end - p);
+            char* key_end = eq ? eq : seg_end;
+            char* value = eq ? eq + 1 : seg_end;
+            int key_len = decode(p, key_end);
+            int value_len = decode(value, seg_end);
+            if (key_len <= 0 || key_len > MAX_KEY_LEN || value_len < 0 ||
+                value_len > MAX_VALUE_LEN) {
+                return false;
+            }
+            m_fields[m_count].key = string_view(p, key_len);
+            m_fields[m_count].value = string_view(value, value_len);
+            ++m_count;
+        }
+        if (!amp) {
+            break;
+        }
+        p = amp + 1;
+    }
+    return true;
+}
+
+bool FormParser::get(string_view key, string_view& value) const {
+    for (int i = 0; i < m_count; ++i) {
+        if (m_fields[i].key == key) {
+            value = m_fields[i].value;
+            return true;
+        }
+    }
+    return false;
+}
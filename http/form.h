@@ -0,0 +1,40 @@
+#ifndef FORM_H
+#define FORM_H
+
+#include <string_view>
+
+using std::string_view;
+
+/*
+    application/x-www-form-urlencoded请求体的解析
+    1. 一次线性扫描把请求体切成key=value，字段以string_view的形式指向请求体本身，不拷贝
+    2. 只有包含%xx或+的字段才原地解码，解码后的长度不会超过原长度，直接覆盖在原位置
+    3. 字段数量和长度都有上限，超过上限或者%xx不合法时整个请求体视为错误
+    解析结果的生命周期与请求体的缓冲区相同
+*/
+class FormParser {
+   public:
+    static const int MAX_FIELDS = 16;      // 最多的字段数
+    static const int MAX_KEY_LEN = 32;     // 字段名的最大长度
+    static const int MAX_VALUE_LEN = 512;  // 字段值解码后的最大长度
+
+    FormParser() : m_count(0) {}
+    // 解析长度为len的请求体，body会被原地解码修改
+    bool parse(char* body, int len);
+    // 按名字查找字段，同名字段取第一个
+    bool get(string_view key, string_view& value) const;
+    int size() const { return m_count; }
+
+   private:
+    struct field {
+        string_view key;
+        string_view value;
+    };
+    // 原地解码[begin, end)，返回解码后的长度，不合法返回-1
+    static int decode(char* begin, char* end);
+
+    field m_fields[MAX_FIELDS];
+    int m_count;
+};
+
+#endif
@@ -1,7 +1,9 @@
 #include "http_conn.h"
+#include "../timer/clock.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <thread>
 
 // 网站根目录
 const char* doc_root = "/home/zht411/Anaconda/WebServer/webserver";
@@ -18,9 +20,15 @@ const char* error_403_form =
 const char* error_404_title = "Not Found";
 const char* error_404_form =
     "The requested file was not found on this server.\n";
+const char* error_405_title = "Method Not Allowed";
+const char* error_405_form =
+    "The request method is not supported for this resource.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form =
     "There was an unusual problem serving the requested file.\n";
+const char* error_503_title = "Service Unavailable";
+const char* error_503_form =
+    "The server is temporarily busy, please try again later.\n";
 
 // 设置文件描述符非阻塞
 int setnonblocking(int fd) {
@@ -31,10 +39,13 @@ int setnonblocking(int fd) {
 }
 
 // 添加文件描述符到epoll对象中
-void addfd(int epollfd, int fd, bool one_shot) {
+void addfd(int epollfd, int fd, bool one_shot, bool edge_trigger) {
     epoll_event ev;
     ev.data.fd = fd;
-    ev.events = EPOLLIN | EPOLLRDHUP; // 水平触发
+    ev.events = EPOLLIN | EPOLLRDHUP; // 默认水平触发
+    if (edge_trigger) {
+        ev.events |= EPOLLET;
+    }
     if (one_shot) {
         ev.events |= EPOLLONESHOT;
     }
@@ -56,33 +67,93 @@ void modfd(int epollfd, int fd, int modev) {
     epoll_event ev;
     ev.data.fd = fd;
     ev.events = modev | EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    if (http_conn::m_edge_trigger) {
+        ev.events |= EPOLLET;
+    }
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev);
 }
 
-// 初始化static变量
-std::unordered_map<string, string> http_conn::user_info;
-
 // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
 int http_conn::m_epollfd = -1;
 // 所有的客户数，全部的http_conn共享，因为是总的客户数
-int http_conn::m_user_count = 0;
+std::atomic<int> http_conn::m_user_count(0);
+// 由main函数在创建线程池后设置
+threadpool<http_conn>* http_conn::m_pools[LANE_NUM] = {nullptr, nullptr};
+UserStore* http_conn::m_store = nullptr;
+int http_conn::m_login_fail_delay = 0;
+bool http_conn::m_reactor = false;
+bool http_conn::m_edge_trigger = false;
+std::atomic<uint64_t> http_conn::m_responses(0);
+std::atomic<uint64_t> http_conn::m_write_waits(0);
+int http_conn::m_retry_after = 1;
+std::atomic<uint64_t> http_conn::m_shed[SHED_NUM];
+std::string http_conn::m_overload_response;
+std::atomic<bool> http_conn::m_draining(false);
+std::atomic<bool> http_conn::m_handed_over(false);
+int http_conn::m_notify_fd = -1;
+std::vector<http_conn*> http_conn::m_closing;
+locker http_conn::m_closing_lock;
 
 // 由线程池中的线程调用，这是处理HTTP请求的入口函数
 void http_conn::process() {
-    // 解析HTTP请求
-    HTTP_CODE read_ret = parse_read();
+    IO_EVENT io = m_io;
+    m_io = IO_NONE;
+    if (io == IO_WRITE) {
+        // Reactor：上次没有写完，socket可写后在工作线程中接着写
+        if (!write_once()) {
+            request_close();
+        }
+        return;
+    }
+    if (io == IO_READ) {
+        // Reactor：由工作线程读入数据
+        if (!read_once()) {
+            request_close();
+            return;
+        }
+        // 读到请求行后才能确定分类并做准入，主线程分发时数据还没读入，不做准入
+        LANE lane = classify();
+        if (fresh_request() && !m_pools[lane]->admit()) {
+            reject(m_sockfd, SHED_LATENCY);
+            request_close();
+            return;
+        }
+        // 不属于当前线程池时换到对应的线程池
+        if (lane != m_lane) {
+            m_lane = lane;
+            if (!m_pools[lane]->append(this)) {
+                reject(m_sockfd, SHED_QUEUE);
+                request_close();
+            }
+            return;
+        }
+    }
+    HTTP_CODE read_ret;
+    if (m_task) {
+        // 挂起的处理协程等待的事件已完成，从挂起处继续
+        read_ret = run_task();
+    } else {
+        // 解析HTTP请求
+        read_ret = parse_read();
+    }
     if (read_ret == NO_REQUEST) {
         // NO_REQUEST表示请求不完整，需要继续接收请求
         modfd(m_epollfd, m_sockfd, EPOLLIN);
         return;
     }
+    if (read_ret == PENDING_REQUEST || read_ret == CLOSED_CONNECTION) {
+        // 处理协程挂起，EPOLLONESHOT没有重置，期间不会再触发该连接的事件；
+        // 或者协程挂起期间连接超时，已经关闭
+        return;
+    }
     // 生成响应
     bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        close_conn();
+    // 两种模型都先在工作线程中直接写，绝大多数响应一次就能写进socket缓冲区；
+    // 写不完时write_once才注册EPOLLOUT，剩下的部分等可写后再写
+    m_responses.fetch_add(1, std::memory_order_relaxed);
+    if (!write_ret || !write_once()) {
+        request_close();
     }
-    // 注册并监听写事件
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);
 }
 
 // 初始化连接，外部调用初始化套接字地址
@@ -90,12 +161,16 @@ void http_conn::init(int connfd, const sockaddr_in& addr) {
     m_sockfd = connfd;
     m_address = addr;
 
-    // 设置端口复用
-    int reuse = 1;
-    setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
-
+    m_close_requested.store(false);
     // 添加到epoll内核中，进行监听
-    addfd(m_epollfd, connfd, true);
+    // accept4创建的socket已经是非阻塞的，不再经过addfd里的fcntl
+    epoll_event ev;
+    ev.data.fd = connfd;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    if (m_edge_trigger) {
+        ev.events |= EPOLLET;
+    }
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, connfd, &ev);
     m_user_count++;
 
     init();
@@ -110,15 +185,20 @@ void http_conn::init() {
     m_check_idx = 0;  // 当前正在解析的字符在读缓冲区中的位置
     m_start_line = 0; // 当前正在解析的行在读缓冲区中的首位置
     m_method = GET;   // 定义请求方法默认为GET
+    m_allow = 0;
     m_url = 0;
     m_version = 0;
     m_host = 0;
     m_string = nullptr;
-    cgi = 0;
     m_content_length = 0;
     bytes_have_send = 0;
     bytes_have_send = 0;
     m_iflink = false;
+    m_cookie_sid = nullptr;
+    m_cookie_len = 0;
+    m_session[0] = '\0';
+    m_lane = LANE_STATIC;
+    m_io = IO_NONE;
 
     bzero(read_buffer, READ_BUFFER_SIZE);
     bzero(write_buffer, WRITE_BUFFER_SIZE);
@@ -128,6 +208,7 @@ void http_conn::init() {
 // 关闭连接
 void http_conn::close_conn() {
     if (m_sockfd != -1) {
+        m_idle.store(false);
         delfd(m_epollfd, m_sockfd);
         --m_user_count; // 减去关闭的用户数
         m_sockfd = -1;
@@ -162,15 +243,168 @@ bool http_conn::read_once() {
     return true;
 }
 
+// 请求行还没有解析时，直接在读缓冲区中找出方法和路径查路由表的标记，不修改缓冲区
+// 请求行不完整或者格式不对时按静态请求处理，由工作线程解析后回复
+http_conn::LANE http_conn::classify() {
+    if (m_check_state != CHECK_STATE_REQUESTLINE) {
+        // 请求行已经解析过，请求体后续的数据交给同一类线程池
+        return m_lane;
+    }
+    const char* end = read_buffer + m_read_idx;
+    const char* p = read_buffer;
+    while (p < end && *p != ' ' && *p != '\t') {
+        ++p;
+    }
+    if (p == end) {
+        return LANE_STATIC;
+    }
+    int method;
+    if (p - read_buffer == 3 && strncasecmp(read_buffer, "GET", 3) == 0) {
+        method = GET;
+    } else if (p - read_buffer == 4 && strncasecmp(read_buffer, "POST", 4) == 0) {
+        method = POST;
+    } else {
+        return LANE_STATIC;
+    }
+    const char* url = p + 1;
+    if (end - url > 7 && strncasecmp(url, "http://", 7) == 0) {
+        url = (const char*)memchr(url + 7, '/', end - url - 7);
+        if (!url) {
+            return LANE_STATIC;
+        }
+    }
+    const char* url_end = url;
+    while (url_end < end && *url_end != ' ' && *url_end != '?') {
+        ++url_end;
+    }
+    if (url_end == end) {
+        return LANE_STATIC;
+    }
+    return (LANE)m_router.tag(method, string_view(url, url_end - url));
+}
+
+// Proactor模式下由主线程在read_once成功后调用；Reactor模式下数据还没有读入，
+// 只有请求体的后续数据能确定分类，新请求先交给静态线程池读取，读到请求行后再换
+bool http_conn::dispatch(IO_EVENT io) {
+    if (io == IO_READ) {
+        m_idle.store(false);
+        m_lane = classify();
+        // 这一类请求的排队时间持续超过目标，新请求直接拒绝，保证已排队请求的延迟；
+        // 请求体的后续数据属于已经准入的请求，不再检查；Reactor模式下由工作线程读入后检查
+        if (!m_reactor && fresh_request() && !m_pools[m_lane]->admit()) {
+            reject(m_sockfd, SHED_LATENCY);
+            return false;
+        }
+    }
+    if (m_reactor) {
+        m_io = io;
+    }
+    if (m_pools[m_lane]->append(this)) {
+        return true;
+    }
+    m_io = IO_NONE;
+    if (io == IO_WRITE) {
+        // 没写完的响应不能丢下，队列满时直接在主线程中写
+        return write_once();
+    }
+    // 这一类请求积压太多，直接回复503并关闭连接，不影响其他类的请求
+    reject(m_sockfd, SHED_QUEUE);
+    return false;
+}
+
+// 过载时的响应每次都一样，启动时生成好，拒绝时不再格式化，也不占用连接的写缓冲区
+void http_conn::init_overload(int retry_after) {
+    m_retry_after = retry_after;
+    char head[256];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 503 %s\r\nRetry-After: %d\r\nContent-Length: %zu\r\n"
+             "Content-Type:text/html\r\nConnection: close\r\n\r\n",
+             error_503_title, retry_after, strlen(error_503_form));
+    m_overload_response = string(head) + error_503_form;
+}
+
+// 响应只有两百多字节，新连接的发送缓冲区一定放得下，发一次即可，发不出去就放弃
+// 发送后关闭写方向再读掉已经到达的请求，接收缓冲区里留有数据时close会发RST，
+// 客户端可能还没读到503就被重置；最多读两次，不能让持续发送的客户端占住主线程，
+// 超过的部分接受偶尔的RST
+void http_conn::reject(int fd, SHED_REASON reason) {
+    m_shed[reason].fetch_add(1, std::memory_order_relaxed);
+    send(fd, m_overload_response.data(), m_overload_response.size(),
+         MSG_NOSIGNAL | MSG_DONTWAIT);
+    shutdown(fd, SHUT_WR);
+    char buf[4096];
+    for (int i = 0; i < 2; ++i) {
+        if (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) < (ssize_t)sizeof(buf)) {
+            break;
+        }
+    }
+}
+
+// 定时器链表只在主线程中操作，工作线程不能直接关闭连接
+// 请求关闭时没有重新注册事件，主线程关闭之前不会再有该连接的事件
+void http_conn::request_close() {
+    m_closing_lock.lock();
+    m_close_requested.store(true);
+    m_closing.push_back(this);
+    m_closing_lock.unlock();
+    uint64_t one = 1;
+    write(m_notify_fd, &one, sizeof(one));
+}
+
+// 连接在请求关闭之后可能已经被定时器关闭（m_sockfd为-1），描述符也可能又分配给了新连接，
+// 新连接的init会清除标志，这样的请求直接丢弃
+void http_conn::take_closing(std::vector<int>& fds) {
+    uint64_t count;
+    read(m_notify_fd, &count, sizeof(count));
+    m_closing_lock.lock();
+    for (http_conn* conn : m_closing) {
+        if (conn->m_close_requested.exchange(false) && conn->m_sockfd != -1) {
+            fds.push_back(conn->m_sockfd);
+        }
+    }
+    m_closing.clear();
+    m_closing_lock.unlock();
+}
+
+void http_conn::log_lane_stats() {
+    static const char* names[LANE_NUM] = {"static", "db"};
+    uint64_t responses = m_responses.exchange(0, std::memory_order_relaxed);
+    uint64_t waits = m_write_waits.exchange(0, std::memory_order_relaxed);
+    if (responses) {
+        LOG_INFO("响应%llu个，写不完注册EPOLLOUT %llu次",
+                 (unsigned long long)responses, (unsigned long long)waits);
+    }
+    uint64_t shed_conn = m_shed[SHED_CONNECTIONS].exchange(0, std::memory_order_relaxed);
+    uint64_t shed_queue = m_shed[SHED_QUEUE].exchange(0, std::memory_order_relaxed);
+    uint64_t shed_latency = m_shed[SHED_LATENCY].exchange(0, std::memory_order_relaxed);
+    if (shed_conn || shed_queue || shed_latency) {
+        LOG_WARN("过载拒绝：连接数超限%llu个，队列已满%llu个，排队超时%llu个",
+                 (unsigned long long)shed_conn, (unsigned long long)shed_queue,
+                 (unsigned long long)shed_latency);
+    }
+    for (int i = 0; i < LANE_NUM; ++i) {
+        threadpool<http_conn>::stats s = m_pools[i]->take_stats();
+        if (s.started == 0 && s.rejected == 0 && s.shed == 0 && s.depth == 0) {
+            continue;
+        }
+        LOG_INFO("线程池%s：排队%zu，开始%llu，完成%llu，拒绝%llu，排队超时拒绝%llu，"
+                 "平均排队%.2fms，最长排队%.2fms，平均处理%.2fms",
+                 names[i], s.depth, (unsigned long long)s.started,
+                 (unsigned long long)s.done, (unsigned long long)s.rejected,
+                 (unsigned long long)s.shed,
+                 s.started ? s.wait_us / 1000.0 / s.started : 0.0,
+                 s.max_wait_us / 1000.0,
+                 s.done ? s.service_us / 1000.0 / s.done : 0.0);
+    }
+}
+
 // 一次性完成HTTP响应
 bool http_conn::write_once() {
     int temp = 0;
 
     if (bytes_to_send == 0) {
         // 将要发送的字节为0，这一次响应结束
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        init();
-        return true;
+        return keep_alive();
     }
 
     while (true) {
@@ -183,6 +417,7 @@ bool http_conn::write_once() {
             // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
             // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
             if (errno == EAGAIN) {
+                m_write_waits.fetch_add(1, std::memory_order_relaxed);
                 modfd(m_epollfd, m_sockfd, EPOLLOUT);
                 return true;
             }
@@ -206,21 +441,43 @@ bool http_conn::write_once() {
         if (bytes_to_send <= 0) {
             // 没有数据要发送了
             unmap();
-            // EPOLL树上重置EPOLLONESHOT事件
-            modfd(m_epollfd, m_sockfd, EPOLLIN);
-
-            if (m_iflink) {
-                init();
-                return true;
-            } else {
+            if (!m_iflink) {
                 return false;
             }
+            // 保持连接，重置状态后在EPOLL树上重置EPOLLONESHOT事件
+            return keep_alive();
         }
     }
 
     return true;
 }
 
+// 先重置状态再注册EPOLLIN，Reactor下注册后下一个请求可能立即被另一个工作线程处理
+// m_idle与m_draining按相反的顺序先写后读：drain没有看到这个连接空闲时，这里一定能看到正在停止服务
+bool http_conn::keep_alive() {
+    init();
+    m_idle.store(true);
+    if (m_draining.load()) {
+        return false;
+    }
+    modfd(m_epollfd, m_sockfd, EPOLLIN);
+    return true;
+}
+
+void http_conn::drain(http_conn* conns, int count) {
+    m_draining.store(true);
+    char c;
+    for (int i = 0; i < count; ++i) {
+        // 工作线程可能刚把连接标成空闲、还没注册事件，关闭读方向不影响它，注册后同样会收到EPOLLRDHUP
+        // 下一个请求已经到达的连接照常处理，响应带Connection: close；
+        // 刚接受、还没发过请求的连接不算空闲，客户端马上就会发来请求
+        if (conns[i].m_idle.load() &&
+            recv(conns[i].m_sockfd, &c, 1, MSG_PEEK | MSG_DONTWAIT) <= 0) {
+            shutdown(conns[i].m_sockfd, SHUT_RD);
+        }
+    }
+}
+
 // 主状态机，解析请求
 http_conn::HTTP_CODE http_conn::parse_read() {
     LINE_STATUS line_status = LINE_OK;
@@ -291,7 +548,6 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
         m_method = GET;
     } else if (strcasecmp(method, "POST") == 0) {
         m_method = POST;
-        cgi = 1;
     } else {
         return BAD_REQUEST;
     }
@@ -356,6 +612,16 @@ http_conn::HTTP_CODE http_conn::parse_headers(char* text) {
         text += 15;
         text += strspn(text, " \t");
         m_content_length = atoi(text);
+    } else if (strncasecmp(text, "Cookie:", 7) == 0) {
+        // Cookie: a=1; sid=0123...; b=2，只记录sid的位置和长度，不拷贝
+        text += 7;
+        for (char* p = strstr(text, "sid="); p; p = strstr(p + 4, "sid=")) {
+            if (p == text || p[-1] == ' ' || p[-1] == ';') {
+                m_cookie_sid = p + 4;
+                m_cookie_len = strcspn(m_cookie_sid, "; \t");
+                break;
+            }
+        }
     } else {
         // 只获取了必需的头，其他的头没有解析
         // LOG_INFO("oop! Unknow header: %s\n", text);
@@ -405,110 +671,239 @@ http_conn::LINE_STATUS http_conn::parse_line() {
     return LINE_OPEN; // 没有找到\r\n，需要继续接收
 }
 
-// 当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性，
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其
-// 映射到内存地址m_file_address处，并告诉调用者获取文件成功
-http_conn::HTTP_CODE http_conn::do_request() {
-    // "/home/zht411/Anaconda/C++/webServerSelf/webserver"
-    // 把网站的根目录拷贝到m_real_file，接下来会在这个根目录下找寻文件
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    // 查看申请访问的地址，如果是post则根据/后端cgi标识来选择对应的资源
-    const char* tmp = strrchr(m_url, '/');
-    // m_url和tmp应该是相等
-    if (cgi == 1 && (*(tmp + 1) == '2' || *(tmp + 1) == '3')) {
-        // 2 登陆 3 注册
-        char name[100], password[100];
-        // 提取用户名和密码
-        // 将用户名和密码提取出来
-        // user=123&password=123
-        int n = strlen(m_string);
-        int idx = 0, i;
-        for (i = 5; i < n && m_string[i] != '&'; ++i) {
-            name[idx++] = m_string[i];
-        }
-        name[idx] = '\0';
-        idx = 0, i += 10;
-        for (; i < n && m_string[i] != '\0'; ++i) {
-            password[idx++] = m_string[i];
-        }
-        password[idx] = '\0';
-        string test_name(name);
-        string test_password(MD5(password).toString());
-        // 获取成功，接下来注册或登录
-        if (*(tmp + 1) == '3') {
-            // 如果是注册，先检测合法性
-            if (user_info.find(test_name) != user_info.end()) {
-                strcpy(m_url, "/registerError.html");
-            } else {
-                string sql("INSERT INTO user_info (name, password) VALUES ('" +
-                           test_name + "', '" + test_password + "');");
-                ConnectionPool* tmp = ConnectionPool::get_pool();
-                std::shared_ptr<Connection> p = tmp->get_connection();
-                MYSQL_RES* result = nullptr;
-                // 更新数据库
-                m_lock.lock();
-                bool ret = p->update(sql);
-                if (ret) {
-                    user_info[test_name] = test_password;
-                    strcpy(m_url, "/log.html");
-                } else {
-                    strcpy(m_url, "/registerError.html");
-                }
-                m_lock.unlock();
-                LOG_INFO("%s",
-                         string("新用户" + test_name + "注册成功").c_str());
-                Log::get_instance()->flush();
-            }
-        } else {
-            // 登陆
-            if (user_info.find(test_name) == user_info.end()) {
-                // 没有这个用户
-                strcpy(m_url, "/logError.html");
-            } else {
-                if (user_info[test_name] == test_password) {
-                    strcpy(m_url, "/welcome.html");
-                    LOG_INFO("%s", string("用户" + test_name + "登陆").c_str());
-                    Log::get_instance()->flush();
-                } else {
-                    strcpy(m_url, "/logError.html");
-                }
-            }
-        }
-    }
-    char ch = *(tmp + 1);
-    auto process_url = [this, len](const char* real) {
-        char* m_url_real = (char*)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, real);
-        // 对网站目录和real实际地址进行拼接
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
-    };
-    switch (ch) {
-        case '0': { // 请求资源为/0，跳转注册页面
-            process_url("/register.html");
-            break;
-        }
-        case '1': { // 请求资源为/1，跳转登陆界面
-            process_url("/log.html");
-            break;
-        }
-        case '5': { // 请求资源为/1，跳转登陆界面
-            process_url("/picture.html");
+// 开始运行处理协程，同步完成时直接返回结果，挂起时返回PENDING_REQUEST
+http_conn::HTTP_CODE http_conn::start_task(task<HTTP_CODE> t) {
+    m_task = std::move(t);
+    m_resume = m_task.handle();
+    return run_task();
+}
+
+// 在当前工作线程中运行处理协程，直到它结束或者挂起等待事件
+http_conn::HTTP_CODE http_conn::run_task() {
+    executor* prev = executor::set_current(this);
+    while (true) {
+        m_co_state.store(CO_RUNNING);
+        std::exchange(m_resume, nullptr).resume();
+        if (m_task.done()) {
             break;
         }
-        case '6': { // 请求资源为/1，跳转登陆界面
-            process_url("/video.html");
-            break;
+        int expected = CO_RUNNING;
+        if (m_co_state.compare_exchange_strong(expected, CO_SUSPENDED)) {
+            executor::set_current(prev);
+            return PENDING_REQUEST;
         }
-        case '7': { // 请求资源为/1，跳转登陆界面
-            process_url("/fans.html");
-            break;
-        }
-        default: { // 在根目录后追加请求资源
-            strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+        // 挂起的过程中等待的事件已经完成，resume_later没有投递，这里接着恢复
+    }
+    executor::set_current(prev);
+    HTTP_CODE ret = m_task.result();
+    m_task = task<HTTP_CODE>();
+    m_co_state.store(CO_IDLE);
+    if (m_close_pending.exchange(false)) {
+        // 协程挂起期间连接超时，推迟的关闭在这里完成
+        close_conn();
+        return CLOSED_CONNECTION;
+    }
+    return ret;
+}
+
+// 等待的事件完成，由主线程或者阻塞操作线程调用
+void http_conn::resume_later(std::coroutine_handle<> h) {
+    m_resume = h;
+    if (m_co_state.exchange(CO_WOKEN) == CO_RUNNING) {
+        // 协程还在挂起的过程中，运行它的线程会发现状态变化并接着恢复
+        return;
+    }
+    if (!m_pools[m_lane]->append(this)) {
+        // 请求队列已满，挂起的协程不能丢下，直接在当前线程中恢复
+        process();
+    }
+}
+
+// 由主线程在连接超时或出错时调用
+bool http_conn::try_close() {
+    m_close_pending.store(true);
+    if (m_co_state.load() != CO_IDLE) {
+        return false;
+    }
+    // 与run_task结尾竞争同一个标志，只有一方会执行关闭
+    if (!m_close_pending.exchange(false)) {
+        return false;
+    }
+    // 工作线程还没被处理的关闭请求作废，避免同一个描述符被关闭两次
+    m_close_requested.store(false);
+    m_idle.store(false);
+    return true;
+}
+
+// 路由表，由init_routes在主线程中建立，之后只读
+http_conn::router_type http_conn::m_router;
+
+// 请求方法的位掩码，用于注册路由
+static const unsigned ON_GET = 1u << http_conn::GET;
+static const unsigned ON_POST = 1u << http_conn::POST;
+
+void http_conn::init_routes() {
+    // 静态路由：固定的路径对应网站根目录下的页面，页面上的表单可能以POST提交
+    static const char* pages[][2] = {{"/0", "/register.html"},
+                                     {"/1", "/log.html"},
+                                     {"/5", "/picture.html"},
+                                     {"/6", "/video.html"},
+                                     {"/7", "/fans.html"}};
+    for (auto& page : pages) {
+        const char* file = page[1];
+        m_router.add(ON_GET | ON_POST, page[0],
+                     [file](http_conn& conn) { return conn.do_file(file); });
+    }
+    // 其余的GET请求按路径读取网站根目录下的文件
+    m_router.add_prefix(ON_GET, "/", [](http_conn& conn) {
+        return conn.do_file(conn.m_url);
+    });
+    // 动态路由：2 登陆 3 注册
+    // 登陆和注册可能等待存储，处理函数是协程，挂起时不占用工作线程；它们在数据库线程池中执行
+    for (const char* path : {"/2", "/2CGISQL.cgi"}) {
+        m_router.add(ON_GET, path, &http_conn::do_session_page);
+        m_router.add(ON_POST, path, [](http_conn& conn) {
+            return conn.start_task(conn.do_login());
+        }, LANE_DB);
+    }
+    m_router.add(ON_POST, "/3CGISQL.cgi", [](http_conn& conn) {
+        return conn.start_task(conn.do_register());
+    }, LANE_DB);
+}
+
+// 当得到一个完整、正确的HTTP请求时，按路径和方法查一次路由表，交给对应的处理函数
+http_conn::HTTP_CODE http_conn::do_request() {
+    // 查询参数不参与路由
+    char* query = strchr(m_url, '?');
+    if (query) {
+        *query = '\0';
+    }
+    const router_type::handler* handler = nullptr;
+    switch (m_router.match(m_method, m_url, handler, &m_allow)) {
+        case router_type::MATCH_OK:
+            return (*handler)(*this);
+        case router_type::MATCH_BAD_METHOD:
+            return METHOD_NOT_ALLOWED;
+        default:
+            return NO_RESOURCE;
+    }
+}
+
+// 请求是否带有有效的会话令牌
+bool http_conn::has_session() {
+    return m_cookie_sid &&
+           SessionTable::get_instance()->validate(m_cookie_sid, m_cookie_len);
+}
+
+// 解析表单user=123&password=123，字段顺序任意，支持%xx编码，
+// 用户名直接从读缓冲区构造，密码只用来计算摘要
+bool http_conn::parse_credentials(string& name, uint8_t digest[16]) {
+    FormParser form;
+    string_view user, password;
+    if (!m_string || !form.parse(m_string, m_content_length) ||
+        !form.get("user", user) || !form.get("password", password) ||
+        user.empty()) {
+        return false;
+    }
+    name.assign(user);
+    // 一次性计算摘要，不构造MD5对象也不分配内存
+    MD5::digest(password.data(), password.size(), digest);
+    return true;
+}
+
+// GET /2：会话有效直接进入欢迎页，否则回到登陆页
+http_conn::HTTP_CODE http_conn::do_session_page() {
+    return do_file(has_session() ? "/welcome.html" : "/log.html");
+}
+
+// POST /2：登陆
+task<http_conn::HTTP_CODE> http_conn::do_login() {
+    if (has_session()) {
+        // 会话有效，直接进入欢迎页，不解析表单、不计算摘要、不查缓存和数据库
+        co_return do_file("/welcome.html");
+    }
+    string test_name;
+    uint8_t digest[16];
+    if (!parse_credentials(test_name, digest)) {
+        co_return BAD_REQUEST;
+    }
+    UserCache* cache = UserCache::get_instance();
+    UserCache::VERIFY_RESULT ret;
+    if (cache->bounded()) {
+        // 缓存容量受限时未命中会同步查询存储，放到阻塞操作线程中执行
+        co_await run_blocking([&]() { ret = cache->verify(test_name, digest); });
+    } else {
+        // 只对用户名所在的分片加读锁，直接比较二进制摘要
+        ret = cache->verify(test_name, digest);
+    }
+    if (ret == UserCache::VERIFY_ERROR) {
+        co_return SERVICE_UNAVAILABLE;
+    }
+    if (ret != UserCache::VERIFY_OK) {
+        // 没有这个用户或者密码错误，延迟响应拖慢暴力猜测，等待期间不占用线程
+        co_await sleep_for(m_login_fail_delay);
+        co_return do_file("/logError.html");
+    }
+    // 签发会话令牌，随响应的Set-Cookie返回
+    if (!SessionTable::get_instance()->create(test_name, m_session)) {
+        m_session[0] = '\0';
+    }
+    LOG_INFO("%s", string("用户" + test_name + "登陆").c_str());
+    Log::get_instance()->flush();
+    co_return do_file("/welcome.html");
+}
+
+// POST /3：注册
+task<http_conn::HTTP_CODE> http_conn::do_register() {
+    string test_name;
+    uint8_t digest[16];
+    if (!parse_credentials(test_name, digest)) {
+        co_return BAD_REQUEST;
+    }
+    if (m_handed_over.load()) {
+        // 新进程已经接手，两个进程各自的缓存看不到对方的注册，只由新进程注册
+        co_return SERVICE_UNAVAILABLE;
+    }
+    char hex[33];
+    MD5::toHex(digest, hex);
+    string test_password(hex);
+    // 先检测合法性
+    UserCache* cache = UserCache::get_instance();
+    if (cache->contains(test_name)) {
+        co_return do_file("/registerError.html");
+    }
+    // 优先走异步注册：提交后协程挂起，工作线程立即返回处理其他请求
+    std::optional<bool> ok = co_await async_result<bool>(
+        [&](async_result<bool>::callback done) {
+            return m_store->insert_async(test_name, test_password, done);
+        });
+    if (!ok) {
+        // 存储不支持异步写入，同步写入可能落盘或等待连接，放到阻塞操作线程中执行
+        UserStore::STORE_RESULT ret;
+        co_await run_blocking(
+            [&]() { ret = m_store->insert(test_name, test_password); });
+        if (ret == UserStore::STORE_BUSY) {
+            // 存储暂时不可用，快速返回503
+            co_return SERVICE_UNAVAILABLE;
         }
+        ok = ret == UserStore::STORE_OK;
     }
+    if (!*ok) {
+        co_return do_file("/registerError.html");
+    }
+    cache->insert(test_name, test_password);
+    LOG_INFO("%s", string("新用户" + test_name + "注册成功").c_str());
+    Log::get_instance()->flush();
+    co_return do_file("/log.html");
+}
+
+// 将path映射到网站根目录下的文件，检查权限后映射到内存
+http_conn::HTTP_CODE http_conn::do_file(const char* path) {
+    // 把网站的根目录拷贝到m_real_file，接下来会在这个根目录下找寻文件
+    strcpy(m_real_file, doc_root);
+    int len = strlen(doc_root);
+    strncpy(m_real_file + len, path, FILENAME_LEN - len - 1);
+    m_real_file[FILENAME_LEN - 1] = '\0';
     // 检查是否有所需要的资源文件，返回值为-1表示写入属性失败，也即没有资源
     if (stat(m_real_file, &m_file_stat) < 0) {
         LOG_INFO("没有资源：%s\n", m_real_file);
@@ -532,7 +927,7 @@ http_conn::HTTP_CODE http_conn::do_request() {
     }
 
     // 以只读方式打开文件
-    int fd = open(m_real_file, O_RDONLY);
+    int fd = open(m_real_file, O_RDONLY | O_CLOEXEC);
     // 创建内存映射
     // 设置为0时表示由系统决定映射区的起始地址
     // PROT_READ页内容能够被读取
@@ -553,13 +948,15 @@ void http_conn::unmap() {
 }
 
 http_conn::FILETYPE http_conn::refresh_content_type() {
-    int url_len = strlen(m_url);
+    // 按实际读取的文件判断，路由改写过的路径（如/0）也能得到正确的类型
+    int url_len = strlen(m_real_file);
     auto type = HTML;
-    if (url_len > 2 && strcmp(m_url + url_len - 2, "js") == 0) {
+    if (url_len > 2 && strcmp(m_real_file + url_len - 2, "js") == 0) {
         type = JS;
-    } else if (url_len > 3 && strcmp(m_url + url_len - 3, "css") == 0) {
+    } else if (url_len > 3 && strcmp(m_real_file + url_len - 3, "css") == 0) {
         type = CSS;
-    } else if (url_len > 4 && strcmp(m_url + url_len - 4, "html") == 0) {
+    } else if (url_len > 4 &&
+               strcmp(m_real_file + url_len - 4, "html") == 0) {
         type = HTML;
     }
     return type;
@@ -589,8 +986,13 @@ bool http_conn::add_status_line(int status, const char* title) {
 }
 
 bool http_conn::add_headers(int content_len) {
-    return add_content_length(content_len) && add_content_type() &&
-           add_linger() && add_blank_line();
+    return add_date() && add_content_length(content_len) &&
+           add_content_type() && add_linger() && add_blank_line();
+}
+
+// Date头直接使用全局时钟缓存好的字符串，每秒只格式化一次
+bool http_conn::add_date() {
+    return add_response("Date: %s\r\n", Clock::get_instance()->http_date());
 }
 
 bool http_conn::add_content_length(int content_len) {
@@ -618,10 +1020,39 @@ bool http_conn::add_linger() {
                         (m_iflink == true) ? "keep-alive" : "close");
 }
 
+// 405响应必须带Allow头，列出路径支持的方法
+bool http_conn::add_allow() {
+    static const char* names[] = {"GET",    "POST",  "HEAD",    "PUT",
+                                  "DELETE", "TRACE", "OPTIONS", "CONNECT"};
+    string allow;
+    for (int i = GET; i <= CONNECT; ++i) {
+        if (m_allow & (1u << i)) {
+            if (!allow.empty()) {
+                allow += ", ";
+            }
+            allow += names[i];
+        }
+    }
+    return add_response("Allow: %s\r\n", allow.c_str());
+}
+
+// 登录成功时下发会话令牌，有效期与会话表一致
+bool http_conn::add_cookie() {
+    if (m_session[0] == '\0') {
+        return true;
+    }
+    return add_response("Set-Cookie: sid=%s; Path=/; HttpOnly; Max-Age=%d\r\n",
+                        m_session, SessionTable::get_instance()->get_ttl());
+}
+
 bool http_conn::add_blank_line() { return add_response("%s", "\r\n"); }
 
 // 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
 bool http_conn::process_write(HTTP_CODE ret) {
+    // 停止服务期间不再保持连接，响应发送完就关闭
+    if (m_draining.load(std::memory_order_relaxed)) {
+        m_iflink = false;
+    }
     switch (ret) {
         // 内部错误，500
         case INTERNAL_ERROR:
@@ -631,6 +1062,15 @@ bool http_conn::process_write(HTTP_CODE ret) {
                 return false;
             }
             break;
+        // 服务器繁忙，503，告知客户端稍后重试
+        case SERVICE_UNAVAILABLE:
+            add_status_line(503, error_503_title);
+            add_response("Retry-After: %d\r\n", m_retry_after);
+            add_headers(strlen(error_503_form));
+            if (!add_content(error_503_form)) {
+                return false;
+            }
+            break;
         // 报文语法有误，404
         case BAD_REQUEST:
             add_status_line(400, error_400_title);
@@ -647,6 +1087,15 @@ bool http_conn::process_write(HTTP_CODE ret) {
                 return false;
             }
             break;
+        // 路径存在但不支持该请求方法，405
+        case METHOD_NOT_ALLOWED:
+            add_status_line(405, error_405_title);
+            add_allow();
+            add_headers(strlen(error_405_form));
+            if (!add_content(error_405_form)) {
+                return false;
+            }
+            break;
         // 资源没有访问权限，403
         case FORBIDDEN_REQUEST:
             add_status_line(403, error_403_title);
@@ -658,6 +1107,7 @@ bool http_conn::process_write(HTTP_CODE ret) {
         //文件存在，200
         case FILE_REQUEST:
             add_status_line(200, ok_200_title);
+            add_cookie();
             add_headers(m_file_stat.st_size);
             m_iv[0].iov_base = write_buffer;
             m_iv[0].iov_len = m_write_idx;
@@ -680,25 +1130,92 @@ bool http_conn::process_write(HTTP_CODE ret) {
     return true;
 }
 
-void http_conn::init_mysql_result(ConnectionPool* conn_pool) {
-    std::shared_ptr<Connection> p = conn_pool->get_connection();
-    string sql = "select name, password from user_info;";
-    // 在user表中检索username，passwd数据，浏览器端输入
-    MYSQL_RES* result = nullptr;
-    // 从表中检索完整的结果集
-    result = p->query(sql);
-    if (!result) {
-        LOG_ERROR("数据库查询失败\n");
+// 从存储读取id大于from的用户写入缓存，high_water更新为读到的最大id
+static bool load_users(UserStore* store, uint64_t from, uint64_t& high_water) {
+    UserCache* cache = UserCache::get_instance();
+    long long loaded = 0;
+    bool ok = store->scan(from, [&](uint64_t id, const string& name,
+                                    const string& password) {
+        if (id > high_water) {
+            high_water = id;
+        }
+        if (cache->insert(name, password)) {
+            ++loaded;
+        } else {
+            LOG_ERROR("用户%s的密码不是MD5，跳过", name.c_str());
+        }
+    });
+    if (!ok) {
+        LOG_ERROR("读取%s存储中的用户失败\n", store->name());
+        return false;
+    }
+    LOG_INFO("从%s存储读取%lld个用户，高水位%llu", store->name(), loaded,
+             (unsigned long long)high_water);
+    return true;
+}
+
+// 自增id在事务提交前就已分配，快照之后提交的小id用户可能落在高水位之下，
+// 补读时往回多读一段，重复写入缓存没有副作用
+static const uint64_t CATCH_UP_MARGIN = 1024;
+// 缓存全部用户时已经载入的最大id，容量受限时为0，未命中会直接查询存储，不需要补读
+static std::atomic<uint64_t> s_high_water(0);
+static bool s_full_cache = false;
+
+void http_conn::init_user_cache(UserStore* store,
+                                const char* snapshot,
+                                int capacity,
+                                int negative_ttl) {
+    UserCache* cache = UserCache::get_instance();
+    if (capacity > 0) {
+        // 容量受限：启动时不加载用户，登录未命中时向存储查询单个用户
+        cache->set_capacity(capacity, negative_ttl);
+        cache->set_loader([store](const string& name, string& password) {
+            return store->find(name, password);
+        });
+        LOG_INFO("用户缓存容量%d，未命中时查询%s存储", capacity,
+                 store->name());
+        return;
+    }
+    s_full_cache = true;
+    uint64_t high_water = 0;
+    if (cache->load(snapshot, high_water)) {
+        // 热启动：映射快照后立即可以服务，后台补读快照之后注册的用户再保存新快照
+        LOG_INFO("载入快照%s，%zu个用户，高水位%llu", snapshot, cache->size(),
+                 (unsigned long long)high_water);
+        std::thread([store, snapshot, high_water]() {
+            uint64_t hw = high_water;
+            uint64_t from =
+                hw > CATCH_UP_MARGIN ? hw - CATCH_UP_MARGIN : 0;
+            bool ok = load_users(store, from, hw);
+            s_high_water.store(hw);
+            if (ok && !UserCache::get_instance()->save(snapshot, hw)) {
+                LOG_ERROR("保存快照%s失败", snapshot);
+            }
+        }).detach();
+        return;
+    }
+    // 冷启动：读取全部用户，读完之前不开始服务，快照在后台保存
+    if (!load_users(store, 0, high_water)) {
+        return;
+    }
+    s_high_water.store(high_water);
+    std::thread([snapshot, high_water]() {
+        if (!UserCache::get_instance()->save(snapshot, high_water)) {
+            LOG_ERROR("保存快照%s失败", snapshot);
+        }
+    }).detach();
+}
+
+// 在后台线程中补读；热启动的补读线程可能还没结束，高水位为0时从头读，重复写入缓存没有副作用
+void http_conn::catch_up_users(UserStore* store) {
+    if (!s_full_cache) {
         return;
     }
-    // 返回结果集中的列数
-    int num_fields = mysql_num_fields(result);
-    // 返回所有字段结构的数组
-    MYSQL_FIELD* fields = mysql_fetch_field(result);
-    // 从结果集里获取下一行，将对应的用户名和密码存到map中
-    while (MYSQL_ROW row = mysql_fetch_row(result)) {
-        string name(row[0]);
-        string password(row[1]);
-        user_info[name] = password;
-    }
-}
\ No newline at end of file
+    std::thread([store]() {
+        uint64_t hw = s_high_water.load();
+        uint64_t from = hw > CATCH_UP_MARGIN ? hw - CATCH_UP_MARGIN : 0;
+        if (load_users(store, from, hw)) {
+            s_high_water.store(hw);
+        }
+    }).detach();
+}
@@ -19,20 +19,29 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "../md5/md5.h"
-#include "../Connection_pool/connectionPool.h"
+#include "../cache/user_cache.h"
+#include "../coroutine/scheduler.h"
+#include "../coroutine/task.h"
 #include "../log/log.h"
+#include "../session/session.h"
+#include "../storage/user_store.h"
+#include "../threadpool/threadpool.h"
+#include "form.h"
+#include "router.h"
 
 using std::string;
 
 // 设置文件描述符非阻塞
 int setnonblocking(int fd);
 
-// 添加文件描述符到epoll对象中
-void addfd(int epollfd, int fd, bool one_shot);
+// 添加文件描述符到epoll对象中，edge_trigger为true时使用边缘触发
+void addfd(int epollfd, int fd, bool one_shot, bool edge_trigger = false);
 
 // 从epoll对象中删除文件描述符
 void delfd(int epollfd, int fd);
@@ -40,7 +49,7 @@ void delfd(int epollfd, int fd);
 // 修改文件描述符，重制socket上的EPOLLONESHOT事件，已确保下一次可读时，EPOLLIN事件能被触发
 void modfd(int epollfd, int fd, int modev);
 
-class http_conn {
+class http_conn : public executor {
 public:
     // 定义一些状态
     // 定义HTTP请求方法，目前只支持GET和POST
@@ -71,6 +80,9 @@ public:
          FILE_REQUEST        :   文件请求,获取文件成功
          INTERNAL_ERROR      :   表示服务器内部错误
          CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+         PENDING_REQUEST     :   处理函数挂起等待事件（数据库、定时器等），完成后恢复
+         SERVICE_UNAVAILABLE :   服务器繁忙（如取数据库连接超时），请客户端稍后重试
+         METHOD_NOT_ALLOWED  :   路径存在但不支持该请求方法
      */
     enum HTTP_CODE {
         NO_REQUEST,
@@ -80,36 +92,101 @@ public:
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        PENDING_REQUEST,
+        SERVICE_UNAVAILABLE,
+        METHOD_NOT_ALLOWED
     };
 
     // 从状态机的三种可能状态，即行的读取状态，分别表示
     // 0.读取到一个完整的行 1.行出错 2.行数据尚且不完整
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
 
-    // 数据库用的哈希表，用来存用户和密码
-    static std::unordered_map<string, string> user_info;
+    // 处理协程的状态：没有协程、正在运行、已挂起、挂起过程中等待的事件已完成
+    enum CO_STATE { CO_IDLE = 0, CO_RUNNING, CO_SUSPENDED, CO_WOKEN };
+
+    // 请求的分类，每类有独立的线程池和队列上限，数据库卡顿不会拖慢静态文件
+    // LANE_STATIC:静态文件等不访问存储的请求 LANE_DB:登录、注册等访问存储的请求
+    enum LANE { LANE_STATIC = 0, LANE_DB, LANE_NUM };
+
+    // 投递给工作线程的IO事件，只在Reactor模式下使用：IO_READ可读，IO_WRITE可写
+    enum IO_EVENT { IO_NONE = 0, IO_READ, IO_WRITE };
+
+    // 过载拒绝的原因：SHED_CONNECTIONS连接数达到上限，SHED_QUEUE请求所属线程池的队列已满，
+    // SHED_LATENCY请求所属线程池的排队时间持续超过目标
+    enum SHED_REASON { SHED_CONNECTIONS = 0, SHED_QUEUE, SHED_LATENCY, SHED_NUM };
+
+    // 路由表：按路径和请求方法找到处理函数，路由的标记为请求的分类
+    typedef Router<http_conn, HTTP_CODE> router_type;
+
 
 public:
     // 所有的连接共享同一个epoll对象，也就是将所有socket上的事件都注册到同一个epoll内核事件中
     static int m_epollfd;
-    // 统计用户数量
-    static int m_user_count;
+    // 统计用户数量，挂起的协程结束时可能由工作线程关闭连接，所以是原子的
+    static std::atomic<int> m_user_count;
+    // 每类请求的线程池，挂起的处理协程恢复时也投递到所属分类的线程池
+    static threadpool<http_conn>* m_pools[LANE_NUM];
+    // 用户数据的存储后端
+    static UserStore* m_store;
     // 读缓冲与写缓冲区大小设定
     static const int READ_BUFFER_SIZE = 2048;
     static const int WRITE_BUFFER_SIZE = 1024;
     // 文件名的最大长度
     static const int FILENAME_LEN = 200;
 
-    http_conn(){};
+    http_conn()
+        : m_co_state(CO_IDLE),
+          m_close_pending(false),
+          m_close_requested(false),
+          m_idle(false) {};
     ~http_conn(){};
     void process();                                 // 处理客户端请求
     void init(int connfd, const sockaddr_in& addr); // 初始化新接收的连接
     void close_conn();                              // 关闭连接
     bool read_once();                               // 一次性读入
     bool write_once();                              // 一次性写出
-    static void init_mysql_result(
-        ConnectionPool* conn_pool); // 将数据库的用户名和密码读到内存里
+    /*
+        连接同一时刻只属于一个线程：EPOLLONESHOT的事件触发后，由主线程或者拿到它的工作线程处理，
+        直到重新注册事件（modfd）或者请求关闭，所以modfd总是处理过程的最后一步
+        工作线程生成响应后直接写，写不完才注册EPOLLOUT，把连接交还给主循环
+    */
+    // 主线程在socket就绪后调用，按请求分类投递到对应的线程池；队列已满时直接回复503
+    // Proactor模式下主线程已经读入数据，只会传入IO_READ；返回false表示连接需要立即关闭
+    bool dispatch(IO_EVENT io);
+    // 工作线程请求关闭的连接，由主线程取出后关闭并删除定时器
+    static void take_closing(std::vector<int>& fds);
+    static void log_lane_stats(); // 输出各线程池上个周期的排队深度和延迟
+    // 停止服务，由主线程在停止接受新连接后调用：之后的响应都带Connection: close，发送完就关闭；
+    // 正在等待下一个请求的长连接关闭读方向，主循环会收到EPOLLRDHUP并按对端关闭处理；
+    // 还没有发过请求的新连接不关闭，等请求处理完或者超时
+    static void drain(http_conn* conns, int count);
+    // 预先生成过载时回复的503响应，retry_after为Retry-After头的秒数，在接受连接之前调用
+    static void init_overload(int retry_after);
+    // 过载时在fd上发一次预先生成的503，不等待也不注册事件，由调用者随后关闭连接
+    static void reject(int fd, SHED_REASON reason);
+    static void init_user_cache(
+        UserStore* store,
+        const char* snapshot,
+        int capacity,
+        int negative_ttl); // 将存储中的用户名和密码读到内存里，优先使用快照
+    // 热升级后旧进程退出时调用，把旧进程在本进程载入用户之后注册的用户补读到缓存中
+    static void catch_up_users(UserStore* store);
+    // 挂起的处理协程等待的事件完成，把连接重新投递到线程池恢复，任意线程均可调用
+    void resume_later(std::coroutine_handle<> h) override;
+    // 请求关闭连接，返回true时由调用者立即关闭；处理协程挂起时推迟到协程结束后由工作线程关闭
+    bool try_close();
+    static void init_routes(); // 注册所有路由，在启动工作线程之前调用
+    static int m_login_fail_delay; // 登录失败后延迟响应的毫秒数，0表示不延迟
+    // 并发模型：false为模拟Proactor，主线程读写socket，工作线程只处理请求；
+    // true为Reactor，主线程只分发就绪事件，读、处理、写都在工作线程中完成
+    static bool m_reactor;
+    static int m_notify_fd; // 工作线程通知主线程有连接需要关闭的eventfd
+    // 连接socket是否使用边缘触发，读写都循环到EAGAIN为止，两种触发方式下都正确
+    static bool m_edge_trigger;
+    static int m_retry_after; // 503响应中Retry-After头的秒数
+    static std::atomic<bool> m_draining; // 是否正在停止服务
+    static std::atomic<bool> m_handed_over; // 热升级后服务已经交给新进程，不再接受注册
 
 private:
     /* data */
@@ -128,11 +205,11 @@ private:
     char* m_url;            // 请求目标的文件地址
     char* m_version;        // HTTP版本
     METHOD m_method;        // 请求方法
+    unsigned m_allow;       // 返回405时路径支持的方法掩码，用于Allow头
     char* m_host;           // 主机名
     int m_content_length;   // 请求报文的请求体的长度
     bool m_iflink;          // HTTP请求是否保持连接
 
-    int cgi; // 是否启用cgi
     struct stat m_file_stat; // 资源状态（存在与否、是否为目录、可读性、大小）
     char* m_file_address; // 客户请求的目标文件被映射到内存中
     struct iovec m_iv[2]; // io向量机制iovec，writev来执行写操作
@@ -141,7 +218,26 @@ private:
     int bytes_to_send;    // 将要发送的字节数
     int bytes_have_send;  // 已经发送的字节数
 
-    locker m_lock; // 保护哈希表
+    task<HTTP_CODE> m_task;          // 挂起的处理协程
+    std::coroutine_handle<> m_resume; // 恢复时从这里继续
+    std::atomic<int> m_co_state;      // 处理协程的状态，CO_STATE
+    std::atomic<bool> m_close_pending; // 超时时协程还没结束，结束后关闭连接
+    char* m_cookie_sid;      // Cookie中的会话令牌，直接指向读缓冲区
+    int m_cookie_len;        // 会话令牌的长度
+    char m_session[SessionTable::TOKEN_LEN + 1]; // 本次登录新签发的令牌，为空表示没有
+    LANE m_lane;             // 当前请求的分类
+    IO_EVENT m_io;           // Reactor模式下待工作线程处理的IO事件
+    std::atomic<bool> m_close_requested; // 工作线程已请求关闭，主线程关闭前连接不会被复用
+    std::atomic<bool> m_idle; // 上一个响应已经发完，正在等待下一个请求，停止服务时可以直接关闭
+
+    static std::vector<http_conn*> m_closing; // 工作线程请求关闭的连接
+    static std::atomic<uint64_t> m_responses;   // 统计周期内生成的响应数
+    static std::atomic<uint64_t> m_write_waits; // 其中写不完、注册EPOLLOUT的次数
+    static std::atomic<uint64_t> m_shed[SHED_NUM]; // 统计周期内按原因分别计数的过载拒绝
+    static std::string m_overload_response;     // 预先生成的503响应
+    static locker m_closing_lock;             // 保护m_closing
+
+    static router_type m_router; // 路由表，所有连接共享
 
 private:
     /* function */
@@ -153,7 +249,22 @@ private:
     bool process_write(HTTP_CODE ret);        // 填充HTTP应答
     void init(); // 初始化除连接以外的所有信息
     char* get_line() { return read_buffer + m_start_line; }
-    HTTP_CODE do_request(); // 生成响应报文
+    HTTP_CODE do_request(); // 查路由表，交给对应的处理函数
+    LANE classify();        // 不解析请求，只从读缓冲区中的请求行判断分类
+    // 还没有开始解析的新请求，只有新请求参与准入，读到一半的请求不会被拒绝
+    bool fresh_request() const {
+        return m_check_state == CHECK_STATE_REQUESTLINE && m_check_idx == 0;
+    }
+    void request_close();   // 由工作线程调用，交给主线程关闭连接
+    bool keep_alive();      // 一次响应结束，重置状态并注册EPOLLIN；停止服务期间返回false
+    HTTP_CODE do_file(const char* path); // 将path映射为服务器上的文件
+    HTTP_CODE do_session_page();         // GET /2，按会话选择页面
+    task<HTTP_CODE> do_login();          // POST /2，登陆
+    task<HTTP_CODE> do_register();       // POST /3，注册
+    HTTP_CODE start_task(task<HTTP_CODE> t); // 开始运行处理协程
+    HTTP_CODE run_task(); // 运行处理协程直到它结束或挂起
+    bool has_session();                  // 请求是否带有有效的会话
+    bool parse_credentials(string& name, uint8_t digest[16]); // 解析表单中的用户名和密码
     void unmap();           // 解除映射
 
     FILETYPE refresh_content_type(); // 更新文件类型
@@ -161,10 +272,13 @@ private:
     bool add_status_line(int status, const char* title);
     bool add_response(const char* format, ...);
     bool add_headers(int content_len);
+    bool add_date();
     bool add_content_length(int content_len);
     bool add_content(const char* content);
     bool add_content_type();
     bool add_linger();
+    bool add_allow();
+    bool add_cookie();
     bool add_blank_line();
 };
 
@@ -0,0 +1,196 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using std::string;
+using std::string_view;
+
+/*
+    路由表，启动时由主线程注册完毕，之后只读，工作线程并发查询不需要加锁
+    1. 精确路径放在哈希表中，一次查找
+    2. 前缀路径放在压缩前缀树（radix trie）中，沿着路径走一遍得到最长的匹配前缀
+    3. 同一路径可以按请求方法注册不同的处理函数，methods为方法的位掩码
+    先查精确路径，查不到再查前缀；路径存在但方法不匹配时返回405
+    每个处理函数可以带一个整数标记，在解析请求之前就能按路径和方法查到，用于请求的分类
+    Request为请求对象，处理函数接收解析好的请求，Result为处理结果
+*/
+template <typename Request, typename Result>
+class Router {
+   public:
+    typedef std::function<Result(Request&)> handler;
+
+    enum MATCH_RESULT {
+        MATCH_OK,            // 找到处理函数
+        MATCH_NOT_FOUND,     // 没有匹配的路径
+        MATCH_BAD_METHOD     // 路径存在但不支持该方法
+    };
+
+    Router() : m_root(new node) {}
+
+    // 注册精确路径
+    void add(unsigned methods, const string& path, handler h, int tag = 0) {
+        route* r = find_exact(path);
+        if (!r) {
+            r = new_route(path);
+            m_exact[r->path] = r;
+        }
+        r->handlers.push_back({methods, std::move(h), tag});
+    }
+    // 注册前缀路径，匹配所有以prefix开头的路径，多个前缀同时匹配时取最长的
+    void add_prefix(unsigned methods, const string& prefix, handler h, int tag = 0) {
+        node* n = insert(prefix);
+        if (!n->target) {
+            n->target = new_route(prefix);
+        }
+        n->target->handlers.push_back({methods, std::move(h), tag});
+    }
+    // 查找path上method对应的处理函数；返回MATCH_BAD_METHOD时，
+    // allowed不为空则写入该路径支持的方法掩码，用于405响应的Allow头
+    MATCH_RESULT match(int method,
+                       string_view path,
+                       const handler*& h,
+                       unsigned* allowed = nullptr) const {
+        const entry* e = nullptr;
+        MATCH_RESULT ret = find(method, path, e, allowed);
+        if (ret == MATCH_OK) {
+            h = &e->h;
+        }
+        return ret;
+    }
+    // 查找path上method对应的处理函数的标记，没有匹配时返回0
+    int tag(int method, string_view path) const {
+        const entry* e = nullptr;
+        return find(method, path, e) == MATCH_OK ? e->tag : 0;
+    }
+
+   private:
+    struct entry {
+        unsigned methods;
+        handler h;
+        int tag;
+    };
+    struct route {
+        string path;
+        std::vector<entry> handlers;
+    };
+    // 前缀树的节点，label为从父节点到本节点的边上的字符串
+    struct node {
+        string label;
+        std::vector<std::unique_ptr<node>> children;
+        route* target = nullptr;  // 以本节点结尾的前缀，没有为nullptr
+    };
+
+    MATCH_RESULT find(int method,
+                      string_view path,
+                      const entry*& e,
+                      unsigned* allowed = nullptr) const {
+        const route* r = nullptr;
+        auto it = m_exact.find(path);
+        if (it != m_exact.end()) {
+            r = it->second;
+        } else {
+            r = longest_prefix(path);
+        }
+        if (!r) {
+            return MATCH_NOT_FOUND;
+        }
+        unsigned methods = 0;
+        for (const auto& candidate : r->handlers) {
+            if (candidate.methods & (1u << method)) {
+                e = &candidate;
+                return MATCH_OK;
+            }
+            methods |= candidate.methods;
+        }
+        if (allowed) {
+            *allowed = methods;
+        }
+        return MATCH_BAD_METHOD;
+    }
+
+    route* new_route(const string& path) {
+        m_routes.emplace_back();
+        m_routes.back().path = path;
+        return &m_routes.back();
+    }
+
+    route* find_exact(string_view path) {
+        auto it = m_exact.find(path);
+        return it == m_exact.end() ? nullptr : it->second;
+    }
+
+    // 插入前缀，必要时把已有的边从公共前缀处拆成两段，返回前缀结尾的节点
+    node* insert(string_view key) {
+        node* n = m_root.get();
+        while (!key.empty()) {
+            node* next = nullptr;
+            for (auto& child : n->children) {
+                if (child->label[0] == key[0]) {
+                    next = child.get();
+                    break;
+                }
+            }
+            if (!next) {
+                std::unique_ptr<node> leaf(new node);
+                leaf->label = string(key);
+                n->children.push_back(std::move(leaf));
+                return n->children.back().get();
+            }
+            size_t common = 0;
+            while (common < next->label.size() && common < key.size() &&
+                   next->label[common] == key[common]) {
+                ++common;
+            }
+            if (common < next->label.size()) {
+                // 拆边：next变成公共前缀部分，原来的内容下移一层
+                std::unique_ptr<node> rest(new node);
+                rest->label = next->label.substr(common);
+                rest->children.swap(next->children);
+                rest->target = next->target;
+                next->label.resize(common);
+                next->target = nullptr;
+                next->children.push_back(std::move(rest));
+            }
+            key.remove_prefix(common);
+            n = next;
+        }
+        return n;
+    }
+
+    const route* longest_prefix(string_view path) const {
+        const node* n = m_root.get();
+        const route* best = n->target;
+        while (!path.empty()) {
+            const node* next = nullptr;
+            for (const auto& child : n->children) {
+                if (child->label[0] == path[0]) {
+                    next = child.get();
+                    break;
+                }
+            }
+            if (!next || path.compare(0, next->label.size(), next->label) != 0) {
+                break;
+            }
+            path.remove_prefix(next->label.size());
+            n = next;
+            if (n->target) {
+                best = n->target;
+            }
+        }
+        return best;
+    }
+
+    std::deque<route> m_routes;  // 所有路由，deque扩容时元素地址不变
+    std::unordered_map<string_view, route*> m_exact;  // 键指向m_routes中的path
+    std::unique_ptr<node> m_root;
+};
+
+#endif
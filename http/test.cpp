@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "form.h"
+#include "router.h"
+
+using namespace std;
+
+// g++ -std=c++17 -O2 test.cpp form.cpp -o test
+
+// #define press_form
+// #define press_route
+
+static int errors = 0;
+
+// 解析body，检查字段key的值是否为expect，expect为nullptr表示整个请求体应当解析失败
+static void check(const char* body, const char* key, const char* expect) {
+    string buf(body);
+    FormParser form;
+    bool ok = form.parse(&buf[0], buf.size());
+    string_view value;
+    if (!expect) {
+        if (ok) {
+            printf("应当失败：%s\n", body);
+            ++errors;
+        }
+        return;
+    }
+    if (!ok || !form.get(key, value) || value != expect) {
+        printf("解析错误：%s 中的 %s\n", body, key);
+        ++errors;
+    }
+}
+
+int main() {
+    check("user=tom&password=123", "user", "tom");
+    check("user=tom&password=123", "password", "123");
+    check("password=123&user=tom", "user", "tom");
+    check("user=a+b%20c&password=x", "user", "a b c");
+    check("user=%E4%BD%A0%e5%a5%bd&password=x", "user", "你好");
+    check("user=tom&password=p%26w%3Dd", "password", "p&w=d");
+    check("user=&password=x", "user", "");
+    check("&&user=tom&", "user", "tom");
+    check("flag&user=tom", "flag", "");
+    check("user=tom&user=amy", "user", "tom");
+    check("us%65r=tom", "user", "tom");
+    // 不合法的%xx、空字段名、超长的值、太多的字段
+    check("user=%zz", "user", nullptr);
+    check("user=%4", "user", nullptr);
+    check("=tom", "user", nullptr);
+    check(("user=" + string(FormParser::MAX_VALUE_LEN + 1, 'a')).c_str(),
+          "user", nullptr);
+    string many;
+    for (int i = 0; i <= FormParser::MAX_FIELDS; ++i) {
+        many += "k" + to_string(i) + "=v&";
+    }
+    check(many.c_str(), "k0", nullptr);
+    // 解码后长度在上限内即可
+    check(("user=" + string(FormParser::MAX_VALUE_LEN, '+')).c_str(), "user",
+          string(FormParser::MAX_VALUE_LEN, ' ').c_str());
+    // 路由：精确路径优先，其次最长前缀；路径存在但方法不对时区分出来
+    struct request {
+        string hit;
+    };
+    typedef Router<request, int> router;
+    const unsigned GET = 1, POST = 2;
+    router routes;
+    auto tag = [](const char* name) {
+        return [name](request& req) {
+            req.hit = name;
+            return 0;
+        };
+    };
+    routes.add(GET | POST, "/0", tag("page0"));
+    routes.add(GET, "/2", tag("get2"));
+    routes.add(POST, "/2", tag("post2"));
+    routes.add_prefix(GET, "/", tag("root"));
+    routes.add_prefix(GET, "/static/", tag("static"));
+    routes.add_prefix(GET, "/style/css/", tag("css"));
+    routes.add_prefix(GET, "/st", tag("st"));  // 拆分已有的边
+    routes.add(POST, "/3", tag("post3"), 1);     // 带分类标记
+    auto route = [&](int method, const char* path, const char* expect) {
+        const router::handler* h = nullptr;
+        request req;
+        router::MATCH_RESULT ret = routes.match(method, path, h);
+        if (ret == router::MATCH_OK) {
+            (*h)(req);
+        } else {
+            req.hit = ret == router::MATCH_BAD_METHOD ? "405" : "404";
+        }
+        if (req.hit != expect) {
+            printf("路由错误：%s 得到 %s\n", path, req.hit.c_str());
+            ++errors;
+        }
+    };
+    route(0, "/0", "page0");
+    route(1, "/0", "page0");
+    route(0, "/2", "get2");
+    route(1, "/2", "post2");
+    route(0, "/20", "root");
+    route(0, "/static/a.js", "static");
+    route(0, "/static", "st");
+    route(0, "/style/css/main.css", "css");
+    route(0, "/style/js/main.js", "st");
+    route(0, "/index.html", "root");
+    route(1, "/index.html", "405");
+    route(0, "nothing", "404");
+    route(1, "/3", "post3");
+    // 方法不匹配时返回路径支持的方法，用于Allow头
+    {
+        const router::handler* h = nullptr;
+        unsigned allowed = 0;
+        errors += routes.match(1, "/index.html", h, &allowed) !=
+                      router::MATCH_BAD_METHOD ||
+                  allowed != GET;
+        errors += routes.match(2, "/2", h, &allowed) !=
+                      router::MATCH_BAD_METHOD ||
+                  allowed != (GET | POST);
+    }
+    // 分类标记：只有方法和路径都匹配时才返回注册的标记
+    errors += routes.tag(1, "/3") != 1;
+    errors += routes.tag(0, "/3") != 0;
+    errors += routes.tag(1, "/2") != 0;
+    errors += routes.tag(0, "/static/a.js") != 0;
+    printf("%s，错误%d个\n", errors ? "测试失败" : "测试通过", errors);
+
+#ifdef press_form
+    // 与原来按固定偏移拷贝到栈上数组的做法对比，典型的登录表单
+    const int N = 10000000;
+    const char* body = "user=test_user_42&password=p%40ssw0rd";
+    char buf[64];
+    size_t len = strlen(body), sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < N; ++i) {
+        memcpy(buf, body, len + 1);
+        FormParser form;
+        string_view user, password;
+        form.parse(buf, len);
+        form.get("user", user);
+        form.get("password", password);
+        sink += user.size() + password.size();
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start)
+                     .count();
+    printf("解析 %.1fns/次 (%zu)\n", sec * 1e9 / N, sink);
+#endif
+#ifdef press_route
+    // 查表的耗时：精确命中与走前缀树命中
+    const int M = 10000000;
+    const router::handler* h = nullptr;
+    size_t hits = 0;
+    for (const char* path : {"/2", "/style/css/main.css"}) {
+        auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < M; ++i) {
+            hits += routes.match(0, path, h) == router::MATCH_OK;
+        }
+        double cost = chrono::duration<double>(chrono::steady_clock::now() -
+                                               begin).count();
+        printf("路由 %s %.1fns/次 (%zu)\n", path, cost * 1e9 / M, hits);
+    }
+#endif
+    return errors != 0;
+}
@@ -7,10 +7,11 @@
 
 /* 
     线程同步机制封装类
-    一共封装了三个类，分别包括：互斥量、条件变量、信号量
+    一共封装了四个类，分别包括：互斥量、条件变量、信号量、读写锁
     1. 互斥量保证不同线程不会进入同一段代码
     2. 条件变量用于某个线程需要在某种条件成立时才去保护它将要操作的临界区，这种情况从而避免了线程不断轮询检查该条件是否成立而降低效率的情况，这是实现了效率提高。在条件满足时，自动退出阻塞，再加锁进行操作
     3. 信号量用来保证两个或多个关键代码段不被并发调用
+    4. 读写锁允许多个读者同时进入，写者独占，适合读多写少的共享数据
 */
 
 class locker {
@@ -40,8 +41,9 @@ class cond {
     bool wait(pthread_mutex_t* m_mutex) {
         return pthread_cond_wait(&m_cond, m_mutex) == 0;
     }
+    // t为绝对时间（CLOCK_REALTIME），超时返回false
     bool timedwait(pthread_mutex_t* m_mutex, struct timespec t) {
-        return pthread_cond_timedwait(&m_cond, m_mutex, &t);
+        return pthread_cond_timedwait(&m_cond, m_mutex, &t) == 0;
     }
     bool signal() { return pthread_cond_signal(&m_cond) == 0; }
     bool broadcast() { return pthread_cond_broadcast(&m_cond); }
@@ -76,4 +78,20 @@ class sem {
     sem_t m_sem;
 };
 
+class rwlocker {
+   public:
+    rwlocker() {
+        if (pthread_rwlock_init(&m_rwlock, NULL) != 0) {
+            throw std::exception();
+        }
+    }
+    ~rwlocker() { pthread_rwlock_destroy(&m_rwlock); }
+    bool rdlock() { return pthread_rwlock_rdlock(&m_rwlock) == 0; }
+    bool wrlock() { return pthread_rwlock_wrlock(&m_rwlock) == 0; }
+    bool unlock() { return pthread_rwlock_unlock(&m_rwlock) == 0; }
+
+   private:
+    pthread_rwlock_t m_rwlock;
+};
+
 #endif
\ No newline at end of file
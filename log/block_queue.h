@@ -17,6 +17,7 @@ class block_queue {
         m_array = new T[m_max_size];
         m_front = -1;
         m_back = -1;
+        m_closed = false;
     }
     ~block_queue();
     void clear();
@@ -28,6 +29,8 @@ class block_queue {
     bool front(T& item);
     bool back(T& item);
     int max_size();
+    // 关闭队列：唤醒所有等待的消费者，之后push失败，pop取完剩下的元素后返回false
+    void close();
 
    private:
     int m_max_size;  // 阻塞队列的最大容量
@@ -35,6 +38,7 @@ class block_queue {
     T* m_array;      // 队列
     int m_front;     //队头坐标
     int m_back;      // 队尾坐标
+    bool m_closed;   // 是否已经关闭
     // 封装一下，利用构造函数的特性直接完成初始化
     cond m_cond;    // 信号量
     locker m_lock;  // 互斥锁
@@ -63,7 +67,7 @@ void block_queue<T>::clear() {
 template <typename T>
 bool block_queue<T>::push(const T& item) {
     m_lock.lock();
-    if (m_size >= m_max_size) {
+    if (m_closed || m_size >= m_max_size) {
         m_cond.broadcast();
         m_lock.unlock();
         return false;
@@ -82,7 +86,8 @@ bool block_queue<T>::pop(T& item) {
     m_lock.lock();
     // 多个消费者的时候使用while而不是if
     while (m_size <= 0) {
-        if (m_cond.wait(m_lock.get()) != 0) {
+        // cond::wait成功时返回true
+        if (m_closed || !m_cond.wait(m_lock.get())) {
             m_lock.unlock();
             return false;
         }
@@ -94,6 +99,15 @@ bool block_queue<T>::pop(T& item) {
     return true;
 }
 
+// 关闭队列
+template <typename T>
+void block_queue<T>::close() {
+    m_lock.lock();
+    m_closed = true;
+    m_cond.broadcast();
+    m_lock.unlock();
+}
+
 // 检查队列是否已满
 template <typename T>
 bool block_queue<T>::full() {
@@ -1,5 +1,5 @@
 #include "log.h"
-#include "sys/time.h"
+#include "../timer/clock.h"
 
 //异步需要设置阻塞队列的长度，同步不需要设置
 bool Log::init(const char* file_name,
@@ -10,9 +10,8 @@ bool Log::init(const char* file_name,
     if (max_queue_size >= 1) {
         m_is_async = true;
         m_queue = new block_queue<string>(max_queue_size);
-        pthread_t tid;
         // flush_log_thread为回调函数，这里表示创建线程异步写日志
-        pthread_create(&tid, nullptr, flush_log_thread, nullptr);
+        pthread_create(&m_tid, nullptr, flush_log_thread, nullptr);
     }
 
     // 输出内容的长度
@@ -26,9 +25,7 @@ bool Log::init(const char* file_name,
     m_buf = new char[m_log_buf_size];
     memset(m_buf, '\0', sizeof(m_log_buf_size));
 
-    time_t t = time(nullptr);
-    struct tm* sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    struct tm my_tm = Clock::get_instance()->local_tm();
 
     // 从后往前找到第一个/的位置
     const char* p = strrchr(file_name, '/');
@@ -52,7 +49,8 @@ bool Log::init(const char* file_name,
     m_today = my_tm.tm_mday;
     // "a"追加到一个文件。
     // 写操作向文件末尾追加数据。如果文件不存在，则创建文件。
-    m_file = fopen(log_full_name, "a");
+    // "e"为glibc扩展，以O_CLOEXEC打开，热升级时不会被新进程继承
+    m_file = fopen(log_full_name, "ae");
     if (m_file == nullptr) {
         return false;
     }
@@ -61,12 +59,10 @@ bool Log::init(const char* file_name,
 
 // 写日志
 void Log::write_log(int level, const char* format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t t = now.tv_sec;
-    // t的值被分解为tm结构
-    struct tm* sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    // 时间取自事件循环刷新的粗粒度时钟，同一秒内不再重复调用localtime
+    Clock* clock = Clock::get_instance();
+    const struct tm& my_tm = clock->local_tm();
+    long usec = clock->wall_usec();
     char s[16] = {0};
     switch (level) {
         case 0:
@@ -109,7 +105,7 @@ void Log::write_log(int level, const char* format, ...) {
             snprintf(new_log, 255, "%s%s%s_%lld", m_log_dir, tail, m_log_name,
                      m_count / m_log_split_lines);
         }
-        m_file = fopen(new_log, "a");
+        m_file = fopen(new_log, "ae");
     }
     m_lock.unlock();
     //将传入的format参数赋值给valst，便于格式化输出
@@ -120,9 +116,7 @@ void Log::write_log(int level, const char* format, ...) {
     m_lock.lock();
     //写入内容格式：时间 + 内容
     //时间格式化，snprintf成功返回写字符的总数，其中不包括结尾的null字符
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
+    int n = snprintf(m_buf, 48, "%s.%06ld %s ", clock->log_time(), usec, s);
     // 内容格式化，用于向字符串中打印数据、数据格式用户自定义
     // 返回写入到字符数组str中的字符个数(不包含终止符)
     int m = vsnprintf(m_buf + n, m_log_buf_size - 1, format, valist);
@@ -131,9 +125,8 @@ void Log::write_log(int level, const char* format, ...) {
     log_str = m_buf;
     m_lock.unlock();
 
-    if (m_is_async && !m_queue->full()) {
-        m_queue->push(log_str);
-    } else {
+    // 队列已满或者已经关闭时直接写文件
+    if (!m_is_async || !m_queue->push(log_str)) {
         m_lock.lock();
         fputs(log_str.c_str(), m_file);
         m_lock.unlock();
@@ -142,6 +135,14 @@ void Log::write_log(int level, const char* format, ...) {
     va_end(valist);
 }
 
+void Log::close() {
+    if (m_is_async) {
+        m_queue->close();
+        pthread_join(m_tid, nullptr);
+    }
+    flush();
+}
+
 void Log::flush(void) {
     m_lock.lock();
     //强制刷新写入流缓冲区
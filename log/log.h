@@ -33,6 +33,8 @@ class Log {
               int max_queue_size);
     void write_log(int level, const char* format, ...);
     void flush(void);
+    // 退出前调用：异步模式下等写线程把队列中剩下的日志写完，然后刷新到文件
+    void close();
 
    private:
     Log() {
@@ -63,6 +65,7 @@ class Log {
 
     FILE* m_file;                  //  打开log文件的文件指针
     block_queue<string>* m_queue;  // 阻塞队列用来存log
+    pthread_t m_tid;               // 异步写日志的线程
     bool m_is_async;               // 是否同步标志位
     locker m_lock;                 // log的操作锁
     char* m_buf;
@@ -8,25 +8,38 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <iostream>
 #include <unistd.h>
+#include <algorithm>
+#include "./config/config.h"
+#include "./coroutine/scheduler.h"
 #include "./http/http_conn.h"
-#include "./Connection_pool/connectionPool.h"
 #include "./locker/locker.h"
 #include "./log/log.h"
+#include "./net/listener.h"
+#include "./session/session.h"
+#include "./storage/user_store.h"
 #include "./threadpool/threadpool.h"
+#include "./timer/clock.h"
 #include "./timer/timer.h"
 
 #define MAX_USERS 65535  // 最大的接入用户个数，也即是最大的文件描述符个数
 #define MAX_EVENT_NUMBER 10000  // 最大可处理的任务数量
 #define TIMESLOT 5              // 最小超时单位
+#define SERVER_CONFIG "./server.conf"  // 服务器配置文件
+#define USER_SNAPSHOT "./user_cache.snap"  // 用户缓存的快照文件
+#define SESSION_TTL 1800  // 登录会话的有效期，单位秒
+#define UPGRADE_ENV "WEBSERVER_UPGRADE_FD"  // 热升级时新进程从这个环境变量得到与旧进程通信的socket
 
 #define SYNLOG  // 同步写日志
 // #define ASYNLOG  // 异步写日志
 
 // 添加文件描述符到epoll对象中
-extern void addfd(int epollfd, int fd, bool one_shot);
+extern void addfd(int epollfd, int fd, bool one_shot, bool edge_trigger);
 
 // 从epoll对象中删除文件描述符
 extern void delfd(int epollfd, int fd);
@@ -40,6 +53,8 @@ extern int setnonblocking(int fd);
 static int pipefd[2];               // 负责读写
 static sort_timer_list timer_list;  // 升序定时器列表
 static int epollfd = 0;
+static http_conn* users = nullptr;  // 客户端连接数组，用文件描述符作为下标
+static int listenfd = -1;           // 监听socket
 
 // 信号处理函数
 void sig_handler(int sig) {
@@ -65,22 +80,106 @@ void addsig(int sig, void(handler)(int), bool restart = true) {
     assert(sigaction(sig, &sa, nullptr) != -1);
 }
 
+// 全连接队列有积压或者系统的溢出计数增长时记录日志，溢出说明握手被丢弃，客户端要等重传
+void log_listen_stats() {
+    static bool has_last = false;
+    static listen_stats last;
+    listen_stats now;
+    if (!read_listen_stats(listenfd, now)) {
+        return;
+    }
+    uint64_t overflows = has_last ? now.overflows - last.overflows : 0;
+    uint64_t drops = has_last ? now.drops - last.drops : 0;
+    if (now.queue_len > 0 || overflows > 0 || drops > 0) {
+        LOG_INFO("全连接队列%u/%u，溢出+%llu，丢弃+%llu", now.queue_len,
+                 now.queue_max, (unsigned long long)overflows,
+                 (unsigned long long)drops);
+    }
+    last = now;
+    has_last = true;
+}
+
+/*
+    热升级：收到SIGUSR2后重新执行磁盘上的可执行文件，部署时它已经被替换成新版本
+    不用/proc/self/exe，它指向的是旧进程启动时的文件；argv[0]需要是路径，例如./server
+    新进程继承与旧进程相连的socket，旧进程通过它把监听socket发过去；
+    自己创建的描述符都带CLOEXEC，libmysqlclient等第三方库打开的不一定，子进程在exec前统一标记一遍
+    返回旧进程这一端，新进程初始化完成、开始接受连接之前写入一个字节，失败返回-1
+*/
+int spawn_upgrade(char* argv[], pid_t& pid) {
+    int chan[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, chan) != 0) {
+        return -1;
+    }
+    // fork之后子进程只能调用异步信号安全的函数，环境变量在fork之前准备好
+    char upgrade_env[64];
+    snprintf(upgrade_env, sizeof(upgrade_env), "%s=%d", UPGRADE_ENV, chan[1]);
+    std::vector<char*> envp;
+    for (char** env = environ; *env; ++env) {
+        if (strncmp(*env, UPGRADE_ENV "=", strlen(UPGRADE_ENV) + 1) != 0) {
+            envp.push_back(*env);
+        }
+    }
+    envp.push_back(upgrade_env);
+    envp.push_back(nullptr);
+    pid = fork();
+    if (pid == 0) {
+        // close_range是异步信号安全的；内核不支持（5.11之前）时失败，只依赖各处创建时的CLOEXEC
+#if defined(SYS_close_range) && defined(CLOSE_RANGE_CLOEXEC)
+        syscall(SYS_close_range, 3, ~0U, CLOSE_RANGE_CLOEXEC);
+#endif
+        fcntl(chan[1], F_SETFD, 0);
+        execve(argv[0], argv, envp.data());
+        _exit(127);
+    }
+    close(chan[1]);
+    if (pid < 0) {
+        close(chan[0]);
+        return -1;
+    }
+    if (!send_listener(chan[0], listenfd)) {
+        close(chan[0]);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return -1;
+    }
+    return chan[0];
+}
+
 //定时处理任务，重新定时以不断触发SIGALRM信号
 void timer_handler() {
     timer_list.tick();
+    // 顺带清理过期的登录会话
+    SessionTable::get_instance()->expire();
+    http_conn::log_lane_stats();
+    log_listen_stats();
     alarm(TIMESLOT);
 }
 
 //定时器回调函数，删除非活动连接在socket上的注册事件，并关闭
 void cb_func(client_data* user_data) {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
-    http_conn::m_user_count--;
+    // 定时器随后由调用者（tick或close_with_timer）删除，先断开连接与它的关联，避免之后再用到已释放的定时器
+    user_data->timer = nullptr;
+    // 处理协程还挂起着，等协程结束后由工作线程关闭
+    if (!users[user_data->sockfd].try_close()) {
+        return;
+    }
+    // 通过close_conn关闭，连接标记为已关闭（m_sockfd为-1），之后迟到的完成通知和关闭请求不会再操作这个描述符
+    users[user_data->sockfd].close_conn();
     LOG_INFO("close fd %d", user_data->sockfd);
     Log::get_instance()->flush();
 }
 
+// 主循环中关闭连接并删除它的定时器；定时器已经到期被tick删除时timer为空，只关闭连接
+void close_with_timer(client_data* user_data) {
+    m_timer* timer = user_data->timer;
+    cb_func(user_data);
+    if (timer) {
+        timer_list.del_timer(timer);
+    }
+}
+
 int main(int argc, char* argv[]) {
 #ifdef SYNLOG
     Log::get_instance()->init("ServerLog", 2000, 800000, 0);  //同步日志模型
@@ -96,70 +195,130 @@ int main(int argc, char* argv[]) {
 
     LOG_INFO("%s", "The server starts working");
 
+    // 由旧进程热升级启动时，监听socket从旧进程接收，不重新绑定端口
+    int inherit_chan = -1;
+    if (const char* env = getenv(UPGRADE_ENV)) {
+        inherit_chan = atoi(env);
+        fcntl(inherit_chan, F_SETFD, FD_CLOEXEC);
+        unsetenv(UPGRADE_ENV);
+    }
+
     //  获取端口号
     int port = atoi(argv[1]);  // argv[0]是程序名称
 
     // 更改对SIGPIPE信号的处理方式
     addsig(SIGPIPE, SIG_IGN);
 
-    // 创建数据库连接池
-    ConnectionPool* conn_pool = ConnectionPool::get_pool();
-    // 测试代码
-    // string sql(
-    //     "INSERT INTO user (name, age, sex) VALUES ('Test_user2', 1, "
-    //     "'female');");
-    // std::shared_ptr<Connection> p = conn_pool->get_connection();
-    // p->update(sql);
-
-    // 创建线程池，初始化线程池
-    threadpool<http_conn>* pool = nullptr;  // 一开始设置为nullptr
+    // 读取服务器配置，文件不存在时全部使用默认值
+    Config* config = Config::get_instance();
+    if (!config->load(SERVER_CONFIG)) {
+        LOG_INFO("%s", "没有找到server.conf，使用默认配置");
+    }
+
+    // 创建用户数据的存储后端
+    UserStore* store = UserStore::create(config);
+    if (!store || !store->init()) {
+        LOG_ERROR("%s", "用户数据存储初始化失败");
+        return 1;
+    }
+    LOG_INFO("用户数据存储：%s", store->name());
+    http_conn::m_store = store;
+    http_conn::init_routes();
+    http_conn::m_login_fail_delay = config->get_int("loginFailDelay", 0);
+    http_conn::m_reactor = config->get_string("concurrency", "proactor") == "reactor";
+    http_conn::m_edge_trigger = config->get_int("edgeTrigger", 0) != 0;
+    // 每轮事件循环最多accept的连接数，剩下的留到下一轮，避免连接风暴时饿死已有连接
+    int accept_budget = std::max(1, config->get_int("acceptBudget", 64));
+    // 连接数上限，0或者超过MAX_USERS时取MAX_USERS，达到上限后新连接直接回复503
+    int max_connections = config->get_int("maxConnections", 0);
+    if (max_connections <= 0 || max_connections > MAX_USERS) {
+        max_connections = MAX_USERS;
+    }
+    http_conn::init_overload(std::max(1, config->get_int("retryAfter", 1)));
+    // 收到SIGTERM后等待已有连接结束的最长秒数
+    int drain_timeout = std::max(0, config->get_int("drainTimeout", 10));
+
+    // 协程调度器：定时器、socket就绪与阻塞操作线程
+    Scheduler* scheduler = Scheduler::get_instance();
+    if (!scheduler->init(config->get_int("ioThreads", 4))) {
+        LOG_ERROR("%s", "协程调度器初始化失败");
+        return 1;
+    }
+
+    // 创建线程池，静态文件与访问存储的请求各用一个，线程数、队列上限和排队时间目标分别配置
+    threadpool<http_conn>* pools[http_conn::LANE_NUM] = {nullptr, nullptr};
+    int queue_interval = config->get_int("queueInterval", 500);
     // 尝试创建线程池
     try {
-        pool = new threadpool<http_conn>;
+        pools[http_conn::LANE_STATIC] = new threadpool<http_conn>(
+            config->get_int("staticThreads", 8),
+            config->get_int("staticQueue", 10000),
+            config->get_int("staticQueueTarget", 0), queue_interval);
+        pools[http_conn::LANE_DB] = new threadpool<http_conn>(
+            config->get_int("dbThreads", 4), config->get_int("dbQueue", 1000),
+            config->get_int("dbQueueTarget", 0), queue_interval);
     } catch (...) {
         LOG_INFO("%s", "服务器线程池创建失败");
         return -1;
     }
 
     LOG_INFO("%s", "服务器线程池创建完成");
+    for (int i = 0; i < http_conn::LANE_NUM; ++i) {
+        http_conn::m_pools[i] = pools[i];
+    }
 
     // 创建保存客户端连接信息的数组
-    http_conn* users = new http_conn[MAX_USERS];
+    users = new http_conn[MAX_USERS];
 
-    // 读取用户名和密码，进行缓存
-    users->init_mysql_result(conn_pool);
+    // 读取用户名和密码，进行缓存；有快照时映射快照后立即开始服务
+    http_conn::init_user_cache(store, USER_SNAPSHOT,
+                               config->get_int("cacheCapacity", 0),
+                               config->get_int("negativeTtl", 60));
+    SessionTable::get_instance()->init(SESSION_TTL);
 
     // 创建监听端口套接字
-    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
-
-    // 设置端口复用，要在绑定之前设置
-    int reuse = 1;
-    setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
-
-    // 绑定
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_port = htons(port);
-    address.sin_addr.s_addr = INADDR_ANY;
-    int ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
-
-    // 监听
-    // 当套接字正在处理客户端请求时，如果有新的请求进来，套接字是没法处理的，只能把它放进缓冲区，待当前请求处理完毕后，再从缓冲区中读取出来处理。如果不断有新的请求进来，它们就按照先后顺序在缓冲区中排队，直到缓冲区满。这个缓冲区，就称为请求队列，这里请求队列长度设置为5
+    // 当套接字正在处理客户端请求时，如果有新的请求进来，套接字是没法处理的，只能把它放进缓冲区，待当前请求处理完毕后，再从缓冲区中读取出来处理。如果不断有新的请求进来，它们就按照先后顺序在缓冲区中排队，直到缓冲区满。这个缓冲区，就称为请求队列，队列长度、延迟接入等由server.conf中的listen*项配置
     // 要注意监听只是关注端口是否有连接到来，如果要连接客户端需要使用accept
-    ret = listen(listenfd, 5);
+    // 热升级时沿用旧进程的监听socket，全连接队列和listen*配置都不变
+    listenfd = inherit_chan >= 0 ? recv_listener(inherit_chan)
+                                 : open_listener(port, listen_profile::load(config));
+    if (listenfd < 0) {
+        LOG_ERROR("%s", "创建监听socket失败");
+        return 1;
+    }
+    // 记下启动时系统的溢出计数，之后每个周期输出增量
+    log_listen_stats();
+    int ret = 0;
 
     // 创建epoll对象，事件数组，添加文件描述符
     epoll_event events[MAX_EVENT_NUMBER];
-    epollfd = epoll_create(5);
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
     assert(epollfd != -1);
 
     // 将监听文件描述符添加到epoll对象中
     // 所有线程都可以操作这个端口，因此不需要oneshot
-    addfd(epollfd, listenfd, false);
+    addfd(epollfd, listenfd, false, http_conn::m_edge_trigger);
     http_conn::m_epollfd = epollfd;
 
+    // 存储后端需要主线程驱动的文件描述符（异步查询、批量窗口定时器等）挂到主循环上
+    std::vector<int> store_fds = store->event_fds();
+    for (int fd : store_fds) {
+        addfd(epollfd, fd, false);
+    }
+    // 协程调度器的定时器与内部epoll同样挂到主循环上
+    std::vector<int> sched_fds = scheduler->event_fds();
+    for (int fd : sched_fds) {
+        addfd(epollfd, fd, false);
+    }
+
+    // 工作线程直接写响应，发现连接需要关闭时通过eventfd通知主线程
+    http_conn::m_notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(http_conn::m_notify_fd != -1);
+    addfd(epollfd, http_conn::m_notify_fd, false);
+    LOG_INFO("并发模型：%s", http_conn::m_reactor ? "Reactor" : "Proactor");
+
     // 创建管道
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
+    ret = socketpair(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pipefd);
     // 设置写端非阻塞
     // 这是因为如果send函数在发送时如果缓存已满会阻塞等待，而定时函数执行的需求等级比较低，为节省信号处理函数的执行时间，因此设置为非阻塞
     setnonblocking(pipefd[1]);
@@ -167,10 +326,21 @@ int main(int argc, char* argv[]) {
 
     addsig(SIGALRM, sig_handler, false);
     addsig(SIGTERM, sig_handler, false);
+    addsig(SIGUSR2, sig_handler, false);
 
-    client_data* users_timers = new client_data[MAX_USERS];
+    client_data* users_timers = new client_data[MAX_USERS]();
 
     bool stop_server = false;
+    // 收到SIGTERM后不立即退出，先停止接受新连接，等已有连接上的请求处理完
+    bool terminate = false;
+    bool draining = false;
+    long long drain_deadline = 0;  // 单调时钟的毫秒数
+    // 收到SIGUSR2后启动新进程交接监听socket，新进程开始接受连接后本进程和SIGTERM一样停止服务
+    bool upgrade = false;
+    int upgrade_chan = -1;
+    pid_t upgrade_pid = -1;
+    // 新进程就绪后保留与它的连接，本进程退出时关闭，新进程据此知道本进程注册的用户都已写入存储
+    int handover_chan = -1;
 
     // 超时标志
     bool timeout = false;
@@ -178,53 +348,119 @@ int main(int argc, char* argv[]) {
 
     LOG_INFO("%s", "服务器开始监听");
     Log::get_instance()->flush();
+    if (inherit_chan >= 0) {
+        // 通知旧进程停止服务，在这之前旧进程一直在接受连接；
+        // 旧进程退出时连接被关闭，之后补读它在本进程载入用户之后注册的用户
+        char ready = 'R';
+        send(inherit_chan, &ready, 1, MSG_NOSIGNAL);
+        addfd(epollfd, inherit_chan, false);
+    }
 
     while (!stop_server) {
-        // 等待监控文件描述符上有事件的产生
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
+        // 等待监控文件描述符上有事件的产生，停止服务期间定期醒来检查连接是否都已结束
+        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, draining ? 100 : -1);
         if (number < 0 && (errno != EINTR)) {
             printf("Epoll failed\n");
             break;
         }
+        // 每轮事件循环刷新一次全局时钟，本轮内的定时器、日志都读取这个值
+        Clock::get_instance()->update();
         for (int i = 0; i < number; ++i) {
             int sockfd = events[i].data.fd;
 
             if (sockfd == listenfd) {
                 // 说明有新的客户端请求连接，需要建立新连接
-                struct sockaddr_in client_addr;
-                socklen_t client_addr_len = sizeof(client_addr);
-                int connfd = accept(sockfd, (struct sockaddr*)&client_addr,
-                                    &client_addr_len);
-                if (connfd < 0) {
-                    printf("errno is: %d\n", errno);
-                    continue;
+                // 一次取出全连接队列中的多个连接，直到队列为空或者用完本轮的配额
+                bool drained = false;
+                for (int n = 0; n < accept_budget; ++n) {
+                    struct sockaddr_in client_addr;
+                    socklen_t client_addr_len = sizeof(client_addr);
+                    // accept4直接创建非阻塞的socket，省掉每个连接的一对fcntl
+                    int connfd = accept4(sockfd, (struct sockaddr*)&client_addr,
+                                         &client_addr_len,
+                                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (connfd < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) {
+                            continue;
+                        }
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            // 描述符用完等错误，边缘触发下也不再重试，等下一个新连接触发
+                            LOG_ERROR("accept errno is: %d", errno);
+                        }
+                        drained = true;
+                        break;
+                    }
+                    if (http_conn::m_user_count >= max_connections ||
+                        connfd >= MAX_USERS) {
+                        // 目前连接数满了，回复503后关闭，客户端不会一直等到超时
+                        http_conn::reject(connfd, http_conn::SHED_CONNECTIONS);
+                        close(connfd);
+                        continue;
+                    }
+                    // 没有异常，将新连接添加到连接数组中
+                    // 因为按顺序从前到后操作不方便，就用文件描述符直接作为索引
+                    users[connfd].init(connfd, client_addr);
+
+                    // 初始化client_data数据
+                    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
+                    users_timers[connfd].address = client_addr;
+                    users_timers[connfd].sockfd = connfd;
+                    // 初始的到时时间是当前的时间+三倍的TIMESLOT
+                    // 回调函数设置为cb_func，遇到信号仅通过管道传递信号值，具体业务逻辑由主线程完成
+                    time_t t = Clock::get_instance()->mono_sec() + TIMESLOT * 3;
+                    m_timer* timer = new m_timer(t, cb_func, &users_timers[connfd]);
+                    users_timers[connfd].timer = timer;
+                    timer_list.add_timer(timer);
                 }
-                if (http_conn::m_user_count >= MAX_USERS) {
-                    // 目前连接数满了
-                    // TODO：给客户端写一个信息：服务器内部正忙
-                    close(connfd);
-                    continue;
+                if (!drained && http_conn::m_edge_trigger) {
+                    // 边缘触发下队列里还有连接时不会再通知，重新注册一次，
+                    // epoll发现监听socket仍然可读会在下一轮再报告
+                    epoll_event ev;
+                    ev.data.fd = listenfd;
+                    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+                    epoll_ctl(epollfd, EPOLL_CTL_MOD, listenfd, &ev);
                 }
-                // 没有异常，将新连接添加到连接数组中
-                // 因为按顺序从前到后操作不方便，就用文件描述符直接作为索引
-                users[connfd].init(connfd, client_addr);
-
-                // 初始化client_data数据
-                // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
-                users_timers[connfd].address = client_addr;
-                users_timers[connfd].sockfd = connfd;
-                // 初始的到时时间是当前的时间+三倍的TIMESLOT
-                // 回调函数设置为cb_func，遇到信号仅通过管道传递信号值，具体业务逻辑由主线程完成
-                time_t t = time(nullptr) + TIMESLOT * 3;
-                m_timer* timer = new m_timer(t, cb_func, &users_timers[connfd]);
-                users_timers[connfd].timer = timer;
-                timer_list.add_timer(timer);
+            } else if (sockfd == upgrade_chan) {
+                // 新进程初始化完成后写入一个字节；没写就关闭说明新进程启动失败，本进程继续服务
+                char ready = 0;
+                bool ok = recv(sockfd, &ready, 1, 0) == 1;
+                if (ok) {
+                    // 从此只有新进程接受注册，本进程收到的注册回复503，客户端重试时连到新进程
+                    epoll_ctl(epollfd, EPOLL_CTL_DEL, upgrade_chan, 0);
+                    handover_chan = upgrade_chan;
+                    upgrade_chan = -1;
+                    http_conn::m_handed_over.store(true);
+                    LOG_INFO("新进程%d已经开始接受连接", upgrade_pid);
+                    terminate = true;
+                } else {
+                    delfd(epollfd, upgrade_chan);
+                    upgrade_chan = -1;
+                    waitpid(upgrade_pid, nullptr, 0);
+                    LOG_ERROR("新进程%d启动失败，继续服务", upgrade_pid);
+                }
+            } else if (sockfd == inherit_chan) {
+                // 旧进程已经退出，它注册的用户都已写入存储，补读到用户缓存中
+                delfd(epollfd, inherit_chan);
+                inherit_chan = -1;
+                LOG_INFO("%s", "旧进程已经退出，补读它注册的用户");
+                http_conn::catch_up_users(store);
             } else if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
                 // 服务器端断开连接，响应定时器关闭
-                m_timer* timer = users_timers[sockfd].timer;
-                timer->cb_func(&users_timers[sockfd]);
-                if (timer) {
-                    timer_list.del_timer(timer);
+                close_with_timer(&users_timers[sockfd]);
+            } else if (std::find(store_fds.begin(), store_fds.end(),
+                                 sockfd) != store_fds.end()) {
+                // 存储后端的事件，完成的请求会被重新投递到线程池
+                store->on_event(sockfd);
+            } else if (std::find(sched_fds.begin(), sched_fds.end(), sockfd) !=
+                       sched_fds.end()) {
+                // 协程等待的定时器到期或socket就绪，交给挂起它的连接恢复
+                scheduler->on_event(sockfd);
+            } else if (sockfd == http_conn::m_notify_fd) {
+                // 工作线程发现对端关闭或读写出错，在这里关闭连接并删除定时器
+                std::vector<int> closing;
+                http_conn::take_closing(closing);
+                for (int fd : closing) {
+                    close_with_timer(&users_timers[fd]);
                 }
             } else if (sockfd == pipefd[0] && (events[i].events & EPOLLIN)) {
                 // 处理信号
@@ -245,7 +481,11 @@ int main(int argc, char* argv[]) {
                                 break;
                             }
                             case SIGTERM: {
-                                stop_server = true;
+                                terminate = true;
+                                break;
+                            }
+                            case SIGUSR2: {
+                                upgrade = true;
                             }
                         }
                     }
@@ -254,37 +494,35 @@ int main(int argc, char* argv[]) {
                 // 有新的活动，重置定时器
                 m_timer* timer = users_timers[sockfd].timer;
                 // 检测到读事件，将该事件放入到请求队列里面
-                if (users[sockfd].read_once()) {
-                    pool->append(users + sockfd);
+                // Reactor模式下由工作线程读，Proactor模式下主线程先读入数据
+                // 按请求分类投递，队列满时回复503
+                if ((http_conn::m_reactor || users[sockfd].read_once()) &&
+                    users[sockfd].dispatch(http_conn::IO_READ)) {
                     // 有数据传输，将该定时器往后移动3个单位
                     // 并调整定时器在双向链表中的位置
                     if (timer) {
-                        timer->expire = time(nullptr) + 3 * TIMESLOT;
+                        timer->expire = Clock::get_instance()->mono_sec() + 3 * TIMESLOT;
                         timer_list.mod_timer(timer);
                     }
                 } else {
                     // 关闭连接，删除定时器
-                    timer->cb_func(&users_timers[sockfd]);
-                    if (timer) {
-                        timer_list.del_timer(timer);
-                    }
+                    close_with_timer(&users_timers[sockfd]);
                 }
             } else if (events[i].events & EPOLLOUT) {
                 // 遇到读事件，一样需要重置相应定时器
                 m_timer* timer = users_timers[sockfd].timer;
-                // 同上，需要一次性写出
-                if (users[sockfd].write_once()) {
+                // 同上，需要一次性写出；Reactor模式下交给工作线程写
+                if (http_conn::m_reactor
+                        ? users[sockfd].dispatch(http_conn::IO_WRITE)
+                        : users[sockfd].write_once()) {
                     if (timer) {
-                        timer->expire = time(nullptr) + 3 * TIMESLOT;
+                        timer->expire = Clock::get_instance()->mono_sec() + 3 * TIMESLOT;
                         timer_list.mod_timer(timer);
                     }
                 } else {
                     // 关闭连接，删除定时器
                     // users[sockfd].close_conn();
-                    timer->cb_func(&users_timers[sockfd]);
-                    if (timer) {
-                        timer_list.del_timer(timer);
-                    }
+                    close_with_timer(&users_timers[sockfd]);
                 }
             }
         }
@@ -292,16 +530,65 @@ int main(int argc, char* argv[]) {
             timer_handler();
             timeout = false;
         }
+        if (upgrade && upgrade_chan == -1 && !draining) {
+            // 升级进行中或者已经在停止服务时不再启动新进程
+            upgrade_chan = spawn_upgrade(argv, upgrade_pid);
+            if (upgrade_chan >= 0) {
+                addfd(epollfd, upgrade_chan, false);
+                LOG_INFO("收到SIGUSR2，启动新进程%d，交接监听socket", upgrade_pid);
+            } else {
+                LOG_ERROR("%s", "启动新进程失败，继续服务");
+            }
+            Log::get_instance()->flush();
+        }
+        upgrade = false;
+        if (terminate && !draining) {
+            // 关闭监听socket，全连接队列里还没accept的连接由内核重置，负载均衡会换一台重试；
+            // 热升级时新进程持有同一个socket，只是本进程不再accept
+            delfd(epollfd, listenfd);
+            listenfd = -1;
+            draining = true;
+            drain_deadline = Clock::get_instance()->mono_ms() + drain_timeout * 1000LL;
+            http_conn::drain(users, MAX_USERS);
+            LOG_INFO("停止接受新连接，等待%d个连接结束，最多%d秒",
+                     http_conn::m_user_count.load(), drain_timeout);
+            Log::get_instance()->flush();
+        }
+        if (draining && (http_conn::m_user_count == 0 ||
+                         Clock::get_instance()->mono_ms() >= drain_deadline)) {
+            stop_server = true;
+        }
+    }
+
+    // 工作线程全部结束之后，不会再有线程处理连接上的请求
+    for (threadpool<http_conn>* pool : pools) {
+        pool->stop();
+    }
+    if (http_conn::m_user_count > 0) {
+        LOG_WARN("%d个连接没有在截止时间内结束", http_conn::m_user_count.load());
     }
+    LOG_INFO("%s", "服务器退出");
+    Log::get_instance()->close();
 
     // 关闭占用的文件描述符
     close(epollfd);
-    close(listenfd);
+    if (listenfd != -1) {
+        close(listenfd);
+    }
     close(pipefd[0]);
     close(pipefd[1]);
-    delete pool;
-    delete[] users;
-    delete[] users_timers;
+    close(http_conn::m_notify_fd);
+    if (handover_chan != -1) {
+        close(handover_chan);
+    }
+    for (threadpool<http_conn>* pool : pools) {
+        delete pool;
+    }
+    // 截止时间到了还有连接没结束时，挂起的协程还可能被阻塞操作线程恢复，连接数组留给进程退出时回收
+    if (http_conn::m_user_count == 0) {
+        delete[] users;
+        delete[] users_timers;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "md5.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // using namespace std;
 
@@ -22,9 +25,11 @@
 
 
 /* F, G, H and I are basic MD5 functions.
+F and G are written with one operation less than the RFC form
+(bit select), which compilers turn into shorter dependency chains.
 */
-#define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
-#define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
 #define H(x, y, z) ((x) ^ (y) ^ (z))
 #define I(x, y, z) ((y) ^ ((x) | (~z)))
 
@@ -36,28 +41,105 @@
 Rotation is separate from addition to prevent recomputation.
 */
 #define FF(a, b, c, d, x, s, ac) { \
-	(a) += F ((b), (c), (d)) + (x) + ac; \
+	(a) += F ((b), (c), (d)) + (x) + (uint32_t)(ac); \
 	(a) = ROTATE_LEFT ((a), (s)); \
 	(a) += (b); \
 }
 #define GG(a, b, c, d, x, s, ac) { \
-	(a) += G ((b), (c), (d)) + (x) + ac; \
+	(a) += G ((b), (c), (d)) + (x) + (uint32_t)(ac); \
 	(a) = ROTATE_LEFT ((a), (s)); \
 	(a) += (b); \
 }
 #define HH(a, b, c, d, x, s, ac) { \
-	(a) += H ((b), (c), (d)) + (x) + ac; \
+	(a) += H ((b), (c), (d)) + (x) + (uint32_t)(ac); \
 	(a) = ROTATE_LEFT ((a), (s)); \
 	(a) += (b); \
 }
 #define II(a, b, c, d, x, s, ac) { \
-	(a) += I ((b), (c), (d)) + (x) + ac; \
+	(a) += I ((b), (c), (d)) + (x) + (uint32_t)(ac); \
 	(a) = ROTATE_LEFT ((a), (s)); \
 	(a) += (b); \
 }
 
+/* The 64 steps of the MD5 transformation, fully unrolled. X(i) is the
+i-th word of the block, so the same list serves the scalar kernel and
+the multi-buffer kernel.
+*/
+#define MD5_STEPS(FF, GG, HH, II) \
+	/* Round 1 */ \
+	FF (a, b, c, d, X( 0), S11, 0xd76aa478); /* 1 */ \
+	FF (d, a, b, c, X( 1), S12, 0xe8c7b756); /* 2 */ \
+	FF (c, d, a, b, X( 2), S13, 0x242070db); /* 3 */ \
+	FF (b, c, d, a, X( 3), S14, 0xc1bdceee); /* 4 */ \
+	FF (a, b, c, d, X( 4), S11, 0xf57c0faf); /* 5 */ \
+	FF (d, a, b, c, X( 5), S12, 0x4787c62a); /* 6 */ \
+	FF (c, d, a, b, X( 6), S13, 0xa8304613); /* 7 */ \
+	FF (b, c, d, a, X( 7), S14, 0xfd469501); /* 8 */ \
+	FF (a, b, c, d, X( 8), S11, 0x698098d8); /* 9 */ \
+	FF (d, a, b, c, X( 9), S12, 0x8b44f7af); /* 10 */ \
+	FF (c, d, a, b, X(10), S13, 0xffff5bb1); /* 11 */ \
+	FF (b, c, d, a, X(11), S14, 0x895cd7be); /* 12 */ \
+	FF (a, b, c, d, X(12), S11, 0x6b901122); /* 13 */ \
+	FF (d, a, b, c, X(13), S12, 0xfd987193); /* 14 */ \
+	FF (c, d, a, b, X(14), S13, 0xa679438e); /* 15 */ \
+	FF (b, c, d, a, X(15), S14, 0x49b40821); /* 16 */ \
+	/* Round 2 */ \
+	GG (a, b, c, d, X( 1), S21, 0xf61e2562); /* 17 */ \
+	GG (d, a, b, c, X( 6), S22, 0xc040b340); /* 18 */ \
+	GG (c, d, a, b, X(11), S23, 0x265e5a51); /* 19 */ \
+	GG (b, c, d, a, X( 0), S24, 0xe9b6c7aa); /* 20 */ \
+	GG (a, b, c, d, X( 5), S21, 0xd62f105d); /* 21 */ \
+	GG (d, a, b, c, X(10), S22,  0x2441453); /* 22 */ \
+	GG (c, d, a, b, X(15), S23, 0xd8a1e681); /* 23 */ \
+	GG (b, c, d, a, X( 4), S24, 0xe7d3fbc8); /* 24 */ \
+	GG (a, b, c, d, X( 9), S21, 0x21e1cde6); /* 25 */ \
+	GG (d, a, b, c, X(14), S22, 0xc33707d6); /* 26 */ \
+	GG (c, d, a, b, X( 3), S23, 0xf4d50d87); /* 27 */ \
+	GG (b, c, d, a, X( 8), S24, 0x455a14ed); /* 28 */ \
+	GG (a, b, c, d, X(13), S21, 0xa9e3e905); /* 29 */ \
+	GG (d, a, b, c, X( 2), S22, 0xfcefa3f8); /* 30 */ \
+	GG (c, d, a, b, X( 7), S23, 0x676f02d9); /* 31 */ \
+	GG (b, c, d, a, X(12), S24, 0x8d2a4c8a); /* 32 */ \
+	/* Round 3 */ \
+	HH (a, b, c, d, X( 5), S31, 0xfffa3942); /* 33 */ \
+	HH (d, a, b, c, X( 8), S32, 0x8771f681); /* 34 */ \
+	HH (c, d, a, b, X(11), S33, 0x6d9d6122); /* 35 */ \
+	HH (b, c, d, a, X(14), S34, 0xfde5380c); /* 36 */ \
+	HH (a, b, c, d, X( 1), S31, 0xa4beea44); /* 37 */ \
+	HH (d, a, b, c, X( 4), S32, 0x4bdecfa9); /* 38 */ \
+	HH (c, d, a, b, X( 7), S33, 0xf6bb4b60); /* 39 */ \
+	HH (b, c, d, a, X(10), S34, 0xbebfbc70); /* 40 */ \
+	HH (a, b, c, d, X(13), S31, 0x289b7ec6); /* 41 */ \
+	HH (d, a, b, c, X( 0), S32, 0xeaa127fa); /* 42 */ \
+	HH (c, d, a, b, X( 3), S33, 0xd4ef3085); /* 43 */ \
+	HH (b, c, d, a, X( 6), S34,  0x4881d05); /* 44 */ \
+	HH (a, b, c, d, X( 9), S31, 0xd9d4d039); /* 45 */ \
+	HH (d, a, b, c, X(12), S32, 0xe6db99e5); /* 46 */ \
+	HH (c, d, a, b, X(15), S33, 0x1fa27cf8); /* 47 */ \
+	HH (b, c, d, a, X( 2), S34, 0xc4ac5665); /* 48 */ \
+	/* Round 4 */ \
+	II (a, b, c, d, X( 0), S41, 0xf4292244); /* 49 */ \
+	II (d, a, b, c, X( 7), S42, 0x432aff97); /* 50 */ \
+	II (c, d, a, b, X(14), S43, 0xab9423a7); /* 51 */ \
+	II (b, c, d, a, X( 5), S44, 0xfc93a039); /* 52 */ \
+	II (a, b, c, d, X(12), S41, 0x655b59c3); /* 53 */ \
+	II (d, a, b, c, X( 3), S42, 0x8f0ccc92); /* 54 */ \
+	II (c, d, a, b, X(10), S43, 0xffeff47d); /* 55 */ \
+	II (b, c, d, a, X( 1), S44, 0x85845dd1); /* 56 */ \
+	II (a, b, c, d, X( 8), S41, 0x6fa87e4f); /* 57 */ \
+	II (d, a, b, c, X(15), S42, 0xfe2ce6e0); /* 58 */ \
+	II (c, d, a, b, X( 6), S43, 0xa3014314); /* 59 */ \
+	II (b, c, d, a, X(13), S44, 0x4e0811a1); /* 60 */ \
+	II (a, b, c, d, X( 4), S41, 0xf7537e82); /* 61 */ \
+	II (d, a, b, c, X(11), S42, 0xbd3af235); /* 62 */ \
+	II (c, d, a, b, X( 2), S43, 0x2ad7d2bb); /* 63 */ \
+	II (b, c, d, a, X( 9), S44, 0xeb86d391); /* 64 */
+
+
+static const uint32_t INIT_STATE[4] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476
+};
 
-const byte MD5::PADDING[64] = { 0x80 };
 const char MD5::HEX[16] = {
 	'0', '1', '2', '3',
 	'4', '5', '6', '7',
@@ -65,6 +147,25 @@ const char MD5::HEX[16] = {
 	'c', 'd', 'e', 'f'
 };
 
+/* Little-endian load and store of a 32-bit word. */
+static inline uint32_t load32(const byte *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+#else
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+#endif
+}
+
+static inline void store32(byte *p, uint32_t v) {
+	p[0] = (byte)v;
+	p[1] = (byte)(v >> 8);
+	p[2] = (byte)(v >> 16);
+	p[3] = (byte)(v >> 24);
+}
+
 /* Default construct. */
 MD5::MD5() {
 	reset();
@@ -101,13 +202,10 @@ const byte* MD5::digest() {
 void MD5::reset() {
 
 	_finished = false;
-	/* reset number of bits. */
-	_count[0] = _count[1] = 0;
+	/* reset number of bytes. */
+	_count = 0;
 	/* Load magic initialization constants. */
-	_state[0] = 0x67452301;
-	_state[1] = 0xefcdab89;
-	_state[2] = 0x98badcfe;
-	_state[3] = 0x10325476;
+	memcpy(_state, INIT_STATE, sizeof(_state));
 }
 
 /* Updating the context with a input buffer. */
@@ -143,17 +241,13 @@ context.
 */
 void MD5::update(const byte *input, size_t length) {
 
-	ulong i, index, partLen;
+	size_t i, index, partLen;
 
 	_finished = false;
 
 	/* Compute number of bytes mod 64 */
-	index = (ulong)((_count[0] >> 3) & 0x3f);
-
-	/* update number of bits */
-	if((_count[0] += ((ulong)length << 3)) < ((ulong)length << 3))
-		_count[1]++;
-	_count[1] += ((ulong)length >> 29);
+	index = (size_t)(_count & 0x3f);
+	_count += length;
 
 	partLen = 64 - index;
 
@@ -161,10 +255,10 @@ void MD5::update(const byte *input, size_t length) {
 	if(length >= partLen) {
 
 		memcpy(&_buffer[index], input, partLen);
-		transform(_buffer);
+		transform(_state, _buffer);
 
 		for (i = partLen; i + 63 < length; i += 64)
-			transform(&input[i]);
+			transform(_state, &input[i]);
 		index = 0;
 
 	} else {
@@ -175,146 +269,213 @@ void MD5::update(const byte *input, size_t length) {
 	memcpy(&_buffer[index], &input[i], length-i);
 }
 
+/* Build the padded last one or two blocks of a message: the bytes
+after the last full block, 0x80, zeros and the bit length.
+Returns the number of blocks written to out.
+*/
+size_t MD5::finalBlocks(const byte *tail, size_t tailLen,
+	uint64_t length, byte out[128]) {
+
+	size_t blocks = tailLen < 56 ? 1 : 2;
+	memcpy(out, tail, tailLen);
+	out[tailLen] = 0x80;
+	memset(out + tailLen + 1, 0, blocks * 64 - 8 - tailLen - 1);
+	uint64_t bits = length << 3;
+	store32(out + blocks * 64 - 8, (uint32_t)bits);
+	store32(out + blocks * 64 - 4, (uint32_t)(bits >> 32));
+	return blocks;
+}
+
 /* MD5 finalization. Ends an MD5 message-_digest operation, writing the
-the message _digest and zeroizing the context.
+the message _digest. The context is left untouched so that more data
+can still be appended.
 */
 void MD5::final() {
 
-	byte bits[8];
-	ulong oldState[4];
-	ulong oldCount[2];
-	ulong index, padLen;
+	uint32_t state[4];
+	byte last[128];
+
+	memcpy(state, _state, sizeof(state));
+	size_t blocks = finalBlocks(_buffer, (size_t)(_count & 0x3f), _count, last);
+	for (size_t i = 0; i < blocks; i++)
+		transform(state, last + i * 64);
 
-	/* Save current state and count. */
-	memcpy(oldState, _state, 16);
-	memcpy(oldCount, _count, 8);
+	/* Store state in digest */
+	for (int i = 0; i < 4; i++)
+		store32(_digest + i * 4, state[i]);
+}
 
-	/* Save number of bits */
-	encode(_count, bits, 8);
+/* MD5 basic transformation. Transforms state based on block. */
+void MD5::transform(uint32_t state[4], const byte block[64]) {
 
-	/* Pad out to 56 mod 64. */
-	index = (ulong)((_count[0] >> 3) & 0x3f);
-	padLen = (index < 56) ? (56 - index) : (120 - index);
-	update(PADDING, padLen);
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], x[16];
 
-	/* Append length (before padding) */
-	update(bits, 8);
+	for (int i = 0; i < 16; i++)
+		x[i] = load32(block + i * 4);
 
-	/* Store state in digest */
-	encode(_state, _digest, 16);
+#define X(i) x[i]
+	MD5_STEPS(FF, GG, HH, II)
+#undef X
 
-	/* Restore current state and count. */
-	memcpy(_state, oldState, 16);
-	memcpy(_count, oldCount, 8);
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
 }
 
-/* MD5 basic transformation. Transforms _state based on block. */
-void MD5::transform(const byte block[64]) {
-
-	ulong a = _state[0], b = _state[1], c = _state[2], d = _state[3], x[16];
-
-	decode(block, x, 64);
-
-	/* Round 1 */
-	FF (a, b, c, d, x[ 0], S11, 0xd76aa478); /* 1 */
-	FF (d, a, b, c, x[ 1], S12, 0xe8c7b756); /* 2 */
-	FF (c, d, a, b, x[ 2], S13, 0x242070db); /* 3 */
-	FF (b, c, d, a, x[ 3], S14, 0xc1bdceee); /* 4 */
-	FF (a, b, c, d, x[ 4], S11, 0xf57c0faf); /* 5 */
-	FF (d, a, b, c, x[ 5], S12, 0x4787c62a); /* 6 */
-	FF (c, d, a, b, x[ 6], S13, 0xa8304613); /* 7 */
-	FF (b, c, d, a, x[ 7], S14, 0xfd469501); /* 8 */
-	FF (a, b, c, d, x[ 8], S11, 0x698098d8); /* 9 */
-	FF (d, a, b, c, x[ 9], S12, 0x8b44f7af); /* 10 */
-	FF (c, d, a, b, x[10], S13, 0xffff5bb1); /* 11 */
-	FF (b, c, d, a, x[11], S14, 0x895cd7be); /* 12 */
-	FF (a, b, c, d, x[12], S11, 0x6b901122); /* 13 */
-	FF (d, a, b, c, x[13], S12, 0xfd987193); /* 14 */
-	FF (c, d, a, b, x[14], S13, 0xa679438e); /* 15 */
-	FF (b, c, d, a, x[15], S14, 0x49b40821); /* 16 */
-
-	/* Round 2 */
-	GG (a, b, c, d, x[ 1], S21, 0xf61e2562); /* 17 */
-	GG (d, a, b, c, x[ 6], S22, 0xc040b340); /* 18 */
-	GG (c, d, a, b, x[11], S23, 0x265e5a51); /* 19 */
-	GG (b, c, d, a, x[ 0], S24, 0xe9b6c7aa); /* 20 */
-	GG (a, b, c, d, x[ 5], S21, 0xd62f105d); /* 21 */
-	GG (d, a, b, c, x[10], S22,  0x2441453); /* 22 */
-	GG (c, d, a, b, x[15], S23, 0xd8a1e681); /* 23 */
-	GG (b, c, d, a, x[ 4], S24, 0xe7d3fbc8); /* 24 */
-	GG (a, b, c, d, x[ 9], S21, 0x21e1cde6); /* 25 */
-	GG (d, a, b, c, x[14], S22, 0xc33707d6); /* 26 */
-	GG (c, d, a, b, x[ 3], S23, 0xf4d50d87); /* 27 */
-	GG (b, c, d, a, x[ 8], S24, 0x455a14ed); /* 28 */
-	GG (a, b, c, d, x[13], S21, 0xa9e3e905); /* 29 */
-	GG (d, a, b, c, x[ 2], S22, 0xfcefa3f8); /* 30 */
-	GG (c, d, a, b, x[ 7], S23, 0x676f02d9); /* 31 */
-	GG (b, c, d, a, x[12], S24, 0x8d2a4c8a); /* 32 */
-
-	/* Round 3 */
-	HH (a, b, c, d, x[ 5], S31, 0xfffa3942); /* 33 */
-	HH (d, a, b, c, x[ 8], S32, 0x8771f681); /* 34 */
-	HH (c, d, a, b, x[11], S33, 0x6d9d6122); /* 35 */
-	HH (b, c, d, a, x[14], S34, 0xfde5380c); /* 36 */
-	HH (a, b, c, d, x[ 1], S31, 0xa4beea44); /* 37 */
-	HH (d, a, b, c, x[ 4], S32, 0x4bdecfa9); /* 38 */
-	HH (c, d, a, b, x[ 7], S33, 0xf6bb4b60); /* 39 */
-	HH (b, c, d, a, x[10], S34, 0xbebfbc70); /* 40 */
-	HH (a, b, c, d, x[13], S31, 0x289b7ec6); /* 41 */
-	HH (d, a, b, c, x[ 0], S32, 0xeaa127fa); /* 42 */
-	HH (c, d, a, b, x[ 3], S33, 0xd4ef3085); /* 43 */
-	HH (b, c, d, a, x[ 6], S34,  0x4881d05); /* 44 */
-	HH (a, b, c, d, x[ 9], S31, 0xd9d4d039); /* 45 */
-	HH (d, a, b, c, x[12], S32, 0xe6db99e5); /* 46 */
-	HH (c, d, a, b, x[15], S33, 0x1fa27cf8); /* 47 */
-	HH (b, c, d, a, x[ 2], S34, 0xc4ac5665); /* 48 */
-
-	/* Round 4 */
-	II (a, b, c, d, x[ 0], S41, 0xf4292244); /* 49 */
-	II (d, a, b, c, x[ 7], S42, 0x432aff97); /* 50 */
-	II (c, d, a, b, x[14], S43, 0xab9423a7); /* 51 */
-	II (b, c, d, a, x[ 5], S44, 0xfc93a039); /* 52 */
-	II (a, b, c, d, x[12], S41, 0x655b59c3); /* 53 */
-	II (d, a, b, c, x[ 3], S42, 0x8f0ccc92); /* 54 */
-	II (c, d, a, b, x[10], S43, 0xffeff47d); /* 55 */
-	II (b, c, d, a, x[ 1], S44, 0x85845dd1); /* 56 */
-	II (a, b, c, d, x[ 8], S41, 0x6fa87e4f); /* 57 */
-	II (d, a, b, c, x[15], S42, 0xfe2ce6e0); /* 58 */
-	II (c, d, a, b, x[ 6], S43, 0xa3014314); /* 59 */
-	II (b, c, d, a, x[13], S44, 0x4e0811a1); /* 60 */
-	II (a, b, c, d, x[ 4], S41, 0xf7537e82); /* 61 */
-	II (d, a, b, c, x[11], S42, 0xbd3af235); /* 62 */
-	II (c, d, a, b, x[ 2], S43, 0x2ad7d2bb); /* 63 */
-	II (b, c, d, a, x[ 9], S44, 0xeb86d391); /* 64 */
-
-	_state[0] += a;
-	_state[1] += b;
-	_state[2] += c;
-	_state[3] += d;
+/* One-shot digest: full blocks are hashed straight from the input,
+only the padded tail is copied to the stack.
+*/
+void MD5::digest(const void *input, size_t length, uint8_t out[16]) {
+
+	const byte *p = (const byte*)input;
+	uint32_t state[4];
+	byte last[128];
+
+	memcpy(state, INIT_STATE, sizeof(state));
+	size_t full = length / 64;
+	for (size_t i = 0; i < full; i++)
+		transform(state, p + i * 64);
+	size_t blocks = finalBlocks(p + full * 64, length % 64, length, last);
+	for (size_t i = 0; i < blocks; i++)
+		transform(state, last + i * 64);
+
+	for (int i = 0; i < 4; i++)
+		store32(out + i * 4, state[i]);
 }
 
-/* Encodes input (ulong) into output (byte). Assumes length is
-a multiple of 4.
+#ifdef __SSE2__
+/* SSE2 versions of the step macros, each 32-bit lane hashes a
+different message.
 */
-void MD5::encode(const ulong *input, byte *output, size_t length) {
+#define VF(x, y, z) _mm_xor_si128((z), _mm_and_si128((x), _mm_xor_si128((y), (z))))
+#define VG(x, y, z) _mm_xor_si128((y), _mm_and_si128((z), _mm_xor_si128((x), (y))))
+#define VH(x, y, z) _mm_xor_si128(_mm_xor_si128((x), (y)), (z))
+#define VI(x, y, z) _mm_xor_si128((y), _mm_or_si128((x), _mm_xor_si128((z), ones)))
+#define VROTATE_LEFT(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32-(n)))
+#define VSTEP(f, a, b, c, d, x, s, ac) { \
+	(a) = _mm_add_epi32((a), _mm_add_epi32(f((b), (c), (d)), \
+		_mm_add_epi32((x), _mm_set1_epi32((int)(ac))))); \
+	(a) = VROTATE_LEFT((a), (s)); \
+	(a) = _mm_add_epi32((a), (b)); \
+}
+#define VFF(a, b, c, d, x, s, ac) VSTEP(VF, a, b, c, d, x, s, ac)
+#define VGG(a, b, c, d, x, s, ac) VSTEP(VG, a, b, c, d, x, s, ac)
+#define VHH(a, b, c, d, x, s, ac) VSTEP(VH, a, b, c, d, x, s, ac)
+#define VII(a, b, c, d, x, s, ac) VSTEP(VI, a, b, c, d, x, s, ac)
+#endif
+
+/* Multi-buffer digest. Lane i walks through the full blocks of
+input[i] and then through its padded tail; a lane whose message is
+shorter than the others keeps its state through the remaining
+iterations by masking.
+*/
+void MD5::digest_multi(const void *const input[], const size_t length[],
+	uint8_t (*out)[16], int n) {
+
+#ifdef __SSE2__
+	static const byte zero[64] = { 0 };
+	byte last[LANES][128];
+	size_t full[LANES], blocks[LANES], rounds = 0;
+
+	for (int i = 0; i < LANES; i++) {
+		if (i < n) {
+			full[i] = length[i] / 64;
+			blocks[i] = full[i] + finalBlocks((const byte*)input[i] + full[i] * 64,
+				length[i] % 64, length[i], last[i]);
+		} else {
+			full[i] = blocks[i] = 0;
+		}
+		if (blocks[i] > rounds)
+			rounds = blocks[i];
+	}
 
-	for(size_t i=0, j=0; j<length; i++, j+=4) {
-		output[j]= (byte)(input[i] & 0xff);
-		output[j+1] = (byte)((input[i] >> 8) & 0xff);
-		output[j+2] = (byte)((input[i] >> 16) & 0xff);
-		output[j+3] = (byte)((input[i] >> 24) & 0xff);
+	const __m128i ones = _mm_set1_epi32(-1);
+	__m128i a = _mm_set1_epi32((int)INIT_STATE[0]);
+	__m128i b = _mm_set1_epi32((int)INIT_STATE[1]);
+	__m128i c = _mm_set1_epi32((int)INIT_STATE[2]);
+	__m128i d = _mm_set1_epi32((int)INIT_STATE[3]);
+	__m128i x[16];
+
+	for (size_t t = 0; t < rounds; t++) {
+		const byte *blk[LANES];
+		int active[LANES];
+		for (int i = 0; i < LANES; i++) {
+			active[i] = t < blocks[i] ? -1 : 0;
+			if (t < full[i])
+				blk[i] = (const byte*)input[i] + t * 64;
+			else if (t < blocks[i])
+				blk[i] = last[i] + (t - full[i]) * 64;
+			else
+				blk[i] = zero;
+		}
+		/* Transpose: x[k] holds word k of every lane. */
+		for (int g = 0; g < 4; g++) {
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(blk[0] + g * 16));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(blk[1] + g * 16));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(blk[2] + g * 16));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(blk[3] + g * 16));
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+			x[g * 4 + 0] = _mm_unpacklo_epi64(t0, t1);
+			x[g * 4 + 1] = _mm_unpackhi_epi64(t0, t1);
+			x[g * 4 + 2] = _mm_unpacklo_epi64(t2, t3);
+			x[g * 4 + 3] = _mm_unpackhi_epi64(t2, t3);
+		}
+		__m128i mask = _mm_set_epi32(active[3], active[2], active[1], active[0]);
+		__m128i aa = a, bb = b, cc = c, dd = d;
+
+#define X(i) x[i]
+		MD5_STEPS(VFF, VGG, VHH, VII)
+#undef X
+
+		a = _mm_add_epi32(a, aa);
+		b = _mm_add_epi32(b, bb);
+		c = _mm_add_epi32(c, cc);
+		d = _mm_add_epi32(d, dd);
+		/* Finished lanes keep their previous state. */
+		a = _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, aa));
+		b = _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, bb));
+		c = _mm_or_si128(_mm_and_si128(mask, c), _mm_andnot_si128(mask, cc));
+		d = _mm_or_si128(_mm_and_si128(mask, d), _mm_andnot_si128(mask, dd));
 	}
+
+	uint32_t sa[4], sb[4], sc[4], sd[4];
+	_mm_storeu_si128((__m128i*)sa, a);
+	_mm_storeu_si128((__m128i*)sb, b);
+	_mm_storeu_si128((__m128i*)sc, c);
+	_mm_storeu_si128((__m128i*)sd, d);
+	for (int i = 0; i < n; i++) {
+		store32(out[i], sa[i]);
+		store32(out[i] + 4, sb[i]);
+		store32(out[i] + 8, sc[i]);
+		store32(out[i] + 12, sd[i]);
+	}
+#else
+	for (int i = 0; i < n; i++)
+		digest(input[i], length[i], out[i]);
+#endif
 }
 
-/* Decodes input (byte) into output (ulong). Assumes length is
-a multiple of 4.
-*/
-void MD5::decode(const byte *input, ulong *output, size_t length) {
+/* Hash n buffers, LANES at a time. */
+void MD5::digest_batch(const void *const input[], const size_t length[],
+	uint8_t (*out)[16], size_t n) {
+
+	for (size_t i = 0; i < n; i += LANES) {
+		int m = n - i < (size_t)LANES ? (int)(n - i) : LANES;
+		digest_multi(input + i, length + i, out + i, m);
+	}
+}
 
-	for(size_t i=0, j=0; j<length; i++, j+=4) {	
-		output[i] = ((ulong)input[j]) | (((ulong)input[j+1]) << 8) |
-			(((ulong)input[j+2]) << 16) | (((ulong)input[j+3]) << 24);
+/* Convert digest to hex without allocating. */
+void MD5::toHex(const uint8_t digest[16], char out[33]) {
+	for (int i = 0; i < 16; i++) {
+		out[i * 2] = HEX[digest[i] >> 4];
+		out[i * 2 + 1] = HEX[digest[i] & 0xf];
 	}
+	out[32] = '\0';
 }
 
 /* Convert byte array to hex string. */
@@ -4,6 +4,7 @@
 #include <string>
 #include <cstring>
 #include <fstream>
+#include <stdint.h>
 
 
 
@@ -27,25 +28,37 @@ public:
 	const byte* digest();
 	string toString();
 	void reset();
+
+	/* One-shot digest of a whole buffer, no allocation. */
+	static void digest(const void *input, size_t length, uint8_t out[16]);
+	/* Multi-buffer digest of up to LANES independent buffers at once
+	(SIMD lanes when available). Buffers may differ in length. */
+	static const int LANES = 4;
+	static void digest_multi(const void *const input[], const size_t length[],
+		uint8_t (*out)[16], int n);
+	/* Hash any number of buffers, LANES at a time. */
+	static void digest_batch(const void *const input[], const size_t length[],
+		uint8_t (*out)[16], size_t n);
+	/* Lower-case hex of a digest, out receives 32 chars and a '\0'. */
+	static void toHex(const uint8_t digest[16], char out[33]);
 private:
 	void update(const byte *input, size_t length);
 	void final();
-	void transform(const byte block[64]);
-	void encode(const ulong *input, byte *output, size_t length);
-	void decode(const byte *input, ulong *output, size_t length);
+	static void transform(uint32_t state[4], const byte block[64]);
+	static size_t finalBlocks(const byte *tail, size_t tailLen,
+		uint64_t length, byte out[128]);
 	string bytesToHexString(const byte *input, size_t length);
 
 	/* class uncopyable */
 	MD5(const MD5&);
 	MD5& operator=(const MD5&);
 private:
-	ulong _state[4];	/* state (ABCD) */
-	ulong _count[2];	/* number of bits, modulo 2^64 (low-order word first) */
+	uint32_t _state[4];	/* state (ABCD) */
+	uint64_t _count;	/* number of bytes hashed */
 	byte _buffer[64];	/* input buffer */
 	byte _digest[16];	/* message digest */
 	bool _finished;		/* calculate finished ? */
 
-	static const byte PADDING[64];	/* padding for calculate */
 	static const char HEX[16];
 	static const size_t BUFFER_SIZE = 1024;
 };
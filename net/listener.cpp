@@ -0,0 +1,204 @@
+#include "listener.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../log/log.h"
+
+listen_profile listen_profile::load(const Config* config) {
+    listen_profile profile;
+    profile.backlog = config->get_int("listenBacklog", 0);
+    profile.defer_accept = config->get_int("listenDeferAccept", 0);
+    profile.fast_open = config->get_int("listenFastOpen", 0);
+    profile.rcvbuf = config->get_int("listenRcvBuf", 0);
+    profile.sndbuf = config->get_int("listenSndBuf", 0);
+    return profile;
+}
+
+int somaxconn() {
+    int value = 4096;
+    FILE* fp = fopen("/proc/sys/net/core/somaxconn", "r");
+    if (fp) {
+        if (fscanf(fp, "%d", &value) != 1 || value <= 0) {
+            value = 4096;
+        }
+        fclose(fp);
+    }
+    return value;
+}
+
+// 设置失败只记录日志，不影响启动
+static void set_option(int fd, int level, int name, int value, const char* what) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+        LOG_ERROR("监听socket设置%s=%d失败，errno %d", what, value, errno);
+    }
+}
+
+int open_listener(int port, const listen_profile& profile) {
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenfd < 0) {
+        return -1;
+    }
+    // 设置端口复用，要在绑定之前设置
+    set_option(listenfd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT");
+    // 缓冲区要在listen之前设置，窗口扩大因子在握手时就确定了
+    if (profile.rcvbuf > 0) {
+        set_option(listenfd, SOL_SOCKET, SO_RCVBUF, profile.rcvbuf, "SO_RCVBUF");
+    }
+    if (profile.sndbuf > 0) {
+        set_option(listenfd, SOL_SOCKET, SO_SNDBUF, profile.sndbuf, "SO_SNDBUF");
+    }
+    if (profile.defer_accept > 0) {
+        set_option(listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, profile.defer_accept,
+                   "TCP_DEFER_ACCEPT");
+    }
+    if (profile.fast_open > 0) {
+        // 还需要net.ipv4.tcp_fastopen打开服务端（第2位）才会生效
+        set_option(listenfd, IPPROTO_TCP, TCP_FASTOPEN, profile.fast_open,
+                   "TCP_FASTOPEN");
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = INADDR_ANY;
+    if (bind(listenfd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        LOG_ERROR("绑定端口%d失败，errno %d", port, errno);
+        close(listenfd);
+        return -1;
+    }
+
+    // 全连接队列：超过somaxconn的部分会被内核静默截断，这里截断后记录实际生效的值
+    int max = somaxconn();
+    int backlog = profile.backlog;
+    if (backlog <= 0 || backlog > max) {
+        backlog = max;
+    }
+    if (listen(listenfd, backlog) != 0) {
+        LOG_ERROR("监听端口%d失败，errno %d", port, errno);
+        close(listenfd);
+        return -1;
+    }
+    LOG_INFO("监听端口%d，全连接队列%d（somaxconn %d），deferAccept %d秒，"
+             "fastOpen %d，rcvbuf %d，sndbuf %d",
+             port, backlog, max, profile.defer_accept, profile.fast_open,
+             profile.rcvbuf, profile.sndbuf);
+    return listenfd;
+}
+
+// 在/proc/net/netstat的TcpExt段中按名字取计数，第一行为名字，第二行为对应的值
+static bool read_tcp_ext(uint64_t& overflows, uint64_t& drops) {
+    FILE* fp = fopen("/proc/net/netstat", "r");
+    if (!fp) {
+        return false;
+    }
+    char line[4096];
+    std::vector<std::string> names;
+    bool found = false;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "TcpExt:", 7) != 0) {
+            continue;
+        }
+        std::istringstream in(line + 7);
+        if (names.empty()) {
+            std::string name;
+            while (in >> name) {
+                names.push_back(name);
+            }
+            continue;
+        }
+        uint64_t value;
+        for (size_t i = 0; i < names.size() && in >> value; ++i) {
+            if (names[i] == "ListenOverflows") {
+                overflows = value;
+            } else if (names[i] == "ListenDrops") {
+                drops = value;
+            }
+        }
+        found = true;
+        break;
+    }
+    fclose(fp);
+    return found;
+}
+
+bool read_listen_stats(int listenfd, listen_stats& stats) {
+    // 对于监听socket，tcpi_unacked是当前全连接队列的长度，tcpi_sacked是队列上限
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(listenfd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) {
+        return false;
+    }
+    stats.queue_len = info.tcpi_unacked;
+    stats.queue_max = info.tcpi_sacked;
+    stats.overflows = stats.drops = 0;
+    return read_tcp_ext(stats.overflows, stats.drops);
+}
+
+bool send_listener(int channel, int listenfd) {
+    // 至少要带一个字节的普通数据，辅助数据才会被发送
+    char byte = 'L';
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &listenfd, sizeof(int));
+    if (sendmsg(channel, &msg, MSG_NOSIGNAL) != 1) {
+        LOG_ERROR("发送监听socket失败，errno %d", errno);
+        return false;
+    }
+    return true;
+}
+
+int recv_listener(int channel) {
+    char byte;
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        LOG_ERROR("接收监听socket失败，errno %d", errno);
+        return -1;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+        LOG_ERROR("%s", "旧进程没有发来监听socket");
+        return -1;
+    }
+    int listenfd;
+    memcpy(&listenfd, CMSG_DATA(cmsg), sizeof(int));
+    int listening = 0;
+    socklen_t len = sizeof(listening);
+    if (getsockopt(listenfd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) != 0 ||
+        !listening) {
+        LOG_ERROR("收到的描述符%d不是监听socket", listenfd);
+        close(listenfd);
+        return -1;
+    }
+    struct sockaddr_in address;
+    len = sizeof(address);
+    getsockname(listenfd, (struct sockaddr*)&address, &len);
+    LOG_INFO("从旧进程接收监听socket，端口%d", ntohs(address.sin_port));
+    return listenfd;
+}
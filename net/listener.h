@@ -0,0 +1,52 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <stdint.h>
+#include "../config/config.h"
+
+/*
+    监听socket的配置，对应server.conf中的listen*项
+    1. backlog：全连接队列长度，内核会把它截断到net.core.somaxconn，
+       不大于0或者超过somaxconn时直接取somaxconn，连接突发时队列满会丢弃握手
+    2. defer_accept：TCP_DEFER_ACCEPT，握手完成后等到客户端发来数据才放进全连接队列，
+       主线程被唤醒时请求已经到达，只连接不发数据的客户端不会占用连接和定时器
+    3. fast_open：TCP_FASTOPEN的队列长度，客户端在SYN中携带请求，省掉一个往返
+    4. rcvbuf、sndbuf：设置在监听socket上，新连接继承；设置后内核不再自动调整该方向的缓冲区
+    以上为0表示不设置，使用内核默认值
+*/
+struct listen_profile {
+    int backlog;
+    int defer_accept;  // 秒
+    int fast_open;
+    int rcvbuf;        // 字节
+    int sndbuf;        // 字节
+
+    static listen_profile load(const Config* config);
+};
+
+// 全连接队列的状态与溢出计数，溢出计数是整个系统的累计值（/proc/net/netstat）
+struct listen_stats {
+    uint32_t queue_len;  // 当前在全连接队列中等待accept的连接数
+    uint32_t queue_max;  // 全连接队列的长度上限
+    uint64_t overflows;  // ListenOverflows：全连接队列满，丢弃握手的次数
+    uint64_t drops;      // ListenDrops：包括溢出在内的所有丢弃
+};
+
+// 读取/proc/sys/net/core/somaxconn，读取失败返回4096（较新内核的默认值）
+int somaxconn();
+
+// 按配置创建、绑定并监听port，返回监听socket，失败返回-1
+int open_listener(int port, const listen_profile& profile);
+
+// 读取监听socket的队列状态和系统的溢出计数，失败返回false
+bool read_listen_stats(int listenfd, listen_stats& stats);
+
+/*
+    热升级时监听socket的交接：旧进程通过Unix域socket以SCM_RIGHTS把监听socket发给新进程，
+    两个进程拿到的是内核中同一个socket，全连接队列不变，交接期间到达的握手照常完成，不会被拒绝
+*/
+bool send_listener(int channel, int listenfd);
+// 接收旧进程发来的监听socket，收到的不是处于监听状态的socket时同样失败，返回-1
+int recv_listener(int channel);
+
+#endif
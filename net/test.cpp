@@ -0,0 +1,124 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include "../log/log.h"
+#include "listener.h"
+
+using namespace std;
+
+// g++ -std=c++17 -O2 test.cpp listener.cpp ../config/config.cpp ../log/log.cpp ../timer/clock.cpp -pthread -o test
+
+static const int PORT = 19006;
+static int errors = 0;
+
+static int get_option(int fd, int level, int name) {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    getsockopt(fd, level, name, &value, &len);
+    return value;
+}
+
+static int connect_local() {
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main() {
+    Log::get_instance()->init("NetTestLog", 2000, 800000, 0);
+    listen_profile profile = {16, 1, 8, 256 * 1024, 512 * 1024};
+    int listenfd = open_listener(PORT, profile);
+    if (listenfd < 0) {
+        printf("open_listener failed\n");
+        return 1;
+    }
+
+    // 1. 选项都已经设置到监听socket上，内核返回的缓冲区大小是设置值的两倍
+    int rcvbuf = get_option(listenfd, SOL_SOCKET, SO_RCVBUF);
+    int sndbuf = get_option(listenfd, SOL_SOCKET, SO_SNDBUF);
+    int defer = get_option(listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT);
+    int tfo = get_option(listenfd, IPPROTO_TCP, TCP_FASTOPEN);
+    printf("rcvbuf %d, sndbuf %d, defer %d, fastopen %d\n", rcvbuf, sndbuf,
+           defer, tfo);
+    errors += rcvbuf < profile.rcvbuf || sndbuf < profile.sndbuf;
+    errors += defer < 1 || tfo != profile.fast_open;
+
+    // 2. 延迟接入：只完成握手的连接不会出现在全连接队列中，发来数据后才能accept
+    // 与服务器一样把监听socket设为非阻塞，队列为空时accept立即返回EAGAIN
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+    int idle = connect_local();
+    this_thread::sleep_for(chrono::milliseconds(100));
+    int deferred = accept4(listenfd, nullptr, nullptr, SOCK_NONBLOCK);
+    printf("idle connection: %s\n",
+           deferred < 0 && errno == EAGAIN ? "deferred" : "accepted");
+    errors += idle < 0 || deferred >= 0;
+    int busy = connect_local();
+    send(busy, "GET / HTTP/1.1\r\n\r\n", 18, 0);
+    this_thread::sleep_for(chrono::milliseconds(100));
+    listen_stats stats;
+    errors += !read_listen_stats(listenfd, stats);
+    printf("queue %u/%u, overflows %llu, drops %llu\n", stats.queue_len,
+           stats.queue_max, (unsigned long long)stats.overflows,
+           (unsigned long long)stats.drops);
+    errors += stats.queue_len != 1 || stats.queue_max != (uint32_t)profile.backlog;
+    int accepted = accept4(listenfd, nullptr, nullptr, SOCK_NONBLOCK);
+    char buf[32];
+    bool has_data = accepted >= 0 && recv(accepted, buf, sizeof(buf), 0) == 18;
+    printf("busy connection: %s\n", has_data ? "accepted with data" : "failed");
+    errors += !has_data;
+
+    // 3. 超过somaxconn的队列长度被截断
+    close(accepted);
+    close(idle);
+    close(busy);
+    close(listenfd);
+    profile = {somaxconn() * 2, 0, 0, 0, 0};
+    listenfd = open_listener(PORT, profile);
+    int extra = connect_local();
+    this_thread::sleep_for(chrono::milliseconds(50));
+    errors += !read_listen_stats(listenfd, stats);
+    printf("backlog %d -> %u (somaxconn %d)\n", profile.backlog,
+           stats.queue_max, somaxconn());
+    errors += stats.queue_max != (uint32_t)somaxconn() || stats.queue_len != 1;
+    close(extra);
+    close(listenfd);
+
+    // 4. 交接：发送方关闭自己的描述符后，接收方拿到的仍是同一个在监听的socket
+    listenfd = open_listener(PORT, listen_profile{16, 0, 0, 0, 0});
+    int chan[2];
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, chan);
+    bool sent = send_listener(chan[0], listenfd);
+    close(listenfd);
+    int inherited = recv_listener(chan[1]);
+    int client = connect_local();
+    accepted = inherited >= 0 ? accept(inherited, nullptr, nullptr) : -1;
+    printf("handoff: %s\n", accepted >= 0 ? "accepted on inherited socket" : "failed");
+    errors += !sent || accepted < 0 || client < 0;
+    close(accepted);
+    close(client);
+    // 不是监听socket时拒绝
+    send_listener(chan[0], chan[0]);
+    int wrong = recv_listener(chan[1]);
+    printf("non-listening fd: %s\n", wrong < 0 ? "rejected" : "accepted");
+    errors += wrong >= 0;
+    close(inherited);
+    close(chan[0]);
+    close(chan[1]);
+
+    printf(errors ? "FAILED\n" : "all passed\n");
+    return errors != 0;
+}
@@ -0,0 +1,108 @@
+#include "session.h"
+#include <string.h>
+#include <sys/random.h>
+#include "../timer/clock.h"
+
+static const char HEX[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+bool SessionTable::parse(const char* token, size_t len, token_key& key) {
+    if (len != TOKEN_LEN) {
+        return false;
+    }
+    uint64_t words[2] = {0, 0};
+    for (int i = 0; i < TOKEN_LEN; ++i) {
+        int v = hex_value(token[i]);
+        if (v < 0) {
+            return false;
+        }
+        words[i / 16] = words[i / 16] << 4 | v;
+    }
+    key.hi = words[0];
+    key.lo = words[1];
+    return true;
+}
+
+bool SessionTable::create(const string& name, char token[33]) {
+    unsigned char bytes[16];
+    if (getrandom(bytes, sizeof(bytes), 0) != sizeof(bytes)) {
+        return false;
+    }
+    for (int i = 0; i < 16; ++i) {
+        token[i * 2] = HEX[bytes[i] >> 4];
+        token[i * 2 + 1] = HEX[bytes[i] & 0xf];
+    }
+    token[TOKEN_LEN] = '\0';
+    token_key key;
+    parse(token, TOKEN_LEN, key);
+    time_t expire = Clock::get_instance()->mono_sec() + m_ttl;
+    shard& s = get_shard(key);
+    s.lock.wrlock();
+    s.sessions[key] = session{name, expire};
+    s.order.emplace_back(key, expire);
+    s.lock.unlock();
+    return true;
+}
+
+bool SessionTable::validate(const char* token, size_t len, string* name) {
+    token_key key;
+    if (!parse(token, len, key)) {
+        return false;
+    }
+    time_t now = Clock::get_instance()->mono_sec();
+    shard& s = get_shard(key);
+    s.lock.rdlock();
+    auto it = s.sessions.find(key);
+    bool ok = it != s.sessions.end() && it->second.expire > now;
+    if (ok && name) {
+        *name = it->second.name;
+    }
+    s.lock.unlock();
+    return ok;
+}
+
+// 只从表中删除，队列中的记录等到过期时再顺带丢弃
+void SessionTable::remove(const char* token, size_t len) {
+    token_key key;
+    if (!parse(token, len, key)) {
+        return;
+    }
+    shard& s = get_shard(key);
+    s.lock.wrlock();
+    s.sessions.erase(key);
+    s.lock.unlock();
+}
+
+void SessionTable::expire() {
+    time_t now = Clock::get_instance()->mono_sec();
+    for (shard& s : m_shards) {
+        s.lock.wrlock();
+        while (!s.order.empty() && s.order.front().second <= now) {
+            auto it = s.sessions.find(s.order.front().first);
+            // 过期时间不一致说明会话已被删除后又以同一令牌签发（几乎不可能），保留新的
+            if (it != s.sessions.end() &&
+                it->second.expire == s.order.front().second) {
+                s.sessions.erase(it);
+            }
+            s.order.pop_front();
+        }
+        s.lock.unlock();
+    }
+}
+
+size_t SessionTable::size() {
+    size_t total = 0;
+    for (shard& s : m_shards) {
+        s.lock.rdlock();
+        total += s.sessions.size();
+        s.lock.unlock();
+    }
+    return total;
+}
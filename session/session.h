@@ -0,0 +1,80 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <time.h>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include "../locker/locker.h"
+
+using std::string;
+
+/*
+    登录会话表
+    登录成功后签发一个随机的会话令牌（128位，十六进制放在Cookie的sid中），
+    之后带着有效令牌的请求不再解析表单、计算MD5、查询用户缓存或数据库。
+    1. 令牌本身是随机数，直接取低64位作为哈希值，按高位分到SHARD_NUM个分片，每个分片一把读写锁
+    2. 所有会话的有效期相同，同一分片内签发顺序就是过期顺序，每个分片用一个队列记录签发顺序，
+       定时器每次只需从队头弹出已过期的会话，不需要扫描整张表
+    3. 过期清理由主循环的定时器（SIGALRM）驱动，校验时也会比较过期时间，不依赖清理的及时性
+*/
+class SessionTable {
+   public:
+    static SessionTable* get_instance() {
+        static SessionTable table;
+        return &table;
+    }
+
+    // 设置会话有效期，单位秒
+    void init(int ttl) { m_ttl = ttl; }
+    int get_ttl() const { return m_ttl; }
+    // 为用户签发令牌，写入token（32个十六进制字符加'\0'），失败返回false
+    bool create(const string& name, char token[33]);
+    // 校验令牌，len为令牌长度，有效时可以通过name取回用户名
+    bool validate(const char* token, size_t len, string* name = nullptr);
+    // 删除会话
+    void remove(const char* token, size_t len);
+    // 清理过期的会话，由定时器调用
+    void expire();
+    // 当前的会话数
+    size_t size();
+
+    static const int SHARD_NUM = 64;
+    static const int TOKEN_LEN = 32;
+
+   private:
+    struct token_key {
+        uint64_t hi;
+        uint64_t lo;
+        bool operator==(const token_key& other) const {
+            return hi == other.hi && lo == other.lo;
+        }
+    };
+    // 令牌是随机数，低64位本身就是均匀的哈希值
+    struct token_hash {
+        size_t operator()(const token_key& key) const { return key.lo; }
+    };
+    struct session {
+        string name;
+        time_t expire;
+    };
+    struct alignas(64) shard {
+        rwlocker lock;
+        std::unordered_map<token_key, session, token_hash> sessions;
+        std::deque<std::pair<token_key, time_t>> order;  // 按签发顺序排列
+    };
+
+    SessionTable() : m_ttl(1800) {}
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+    static bool parse(const char* token, size_t len, token_key& key);
+    shard& get_shard(const token_key& key) { return m_shards[key.hi >> 58]; }
+
+    int m_ttl;
+    shard m_shards[SHARD_NUM];
+};
+
+static_assert(SessionTable::SHARD_NUM == 64, "get_shard takes the top 6 bits");
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../timer/clock.h"
+#include "session.h"
+
+using namespace std;
+
+// g++ -std=c++17 -O2 test.cpp session.cpp ../timer/clock.cpp -pthread -o test
+
+int main() {
+    SessionTable* table = SessionTable::get_instance();
+    table->init(1);
+    int errors = 0;
+
+    const int N = 100000;
+    vector<string> tokens(N);
+    char token[33];
+    for (int i = 0; i < N; ++i) {
+        if (!table->create("user" + to_string(i), token)) {
+            ++errors;
+        }
+        tokens[i] = token;
+    }
+    string name;
+    errors += !table->validate(tokens[42].c_str(), tokens[42].size(), &name);
+    errors += name != "user42";
+    // 格式不对、长度不对、不存在的令牌
+    errors += table->validate("not-a-token", 11);
+    errors += table->validate(tokens[0].c_str(), 31);
+    string forged(tokens[0]);
+    forged[0] = forged[0] == 'a' ? 'b' : 'a';
+    errors += table->validate(forged.c_str(), forged.size());
+    table->remove(tokens[1].c_str(), tokens[1].size());
+    errors += table->validate(tokens[1].c_str(), tokens[1].size());
+
+    auto start = chrono::steady_clock::now();
+    int valid = 0;
+    for (int i = 0; i < N; ++i) {
+        valid += table->validate(tokens[i].c_str(), tokens[i].size());
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() -
+                                               start)
+                    .count();
+    printf("validate: %.1f ns/op, %d valid (expect %d)\n", ns / N, valid,
+           N - 1);
+    errors += valid != N - 1;
+
+    // 过期：超过有效期后校验失败，定时器清理后表为空
+    sleep(2);
+    Clock::get_instance()->update();
+    errors += table->validate(tokens[42].c_str(), tokens[42].size());
+    table->expire();
+    printf("after expire: %zu sessions\n", table->size());
+    errors += table->size() != 0;
+
+    printf("errors %d\n%s\n", errors, errors == 0 ? "PASS" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#include "local_store.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../log/log.h"
+
+LocalStore::~LocalStore() {
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+// FNV-1a，覆盖两个长度和全部内容，用来识别写了一半的记录
+uint32_t LocalStore::checksum(const char* name,
+                              size_t name_len,
+                              const char* pwd,
+                              size_t pwd_len) {
+    uint32_t h = 2166136261u;
+    auto mix = [&h](const void* data, size_t len) {
+        const unsigned char* p = (const unsigned char*)data;
+        for (size_t i = 0; i < len; ++i) {
+            h = (h ^ p[i]) * 16777619u;
+        }
+    };
+    uint16_t lens[2] = {(uint16_t)name_len, (uint16_t)pwd_len};
+    mix(lens, sizeof(lens));
+    mix(name, name_len);
+    mix(pwd, pwd_len);
+    return h;
+}
+
+bool LocalStore::init() {
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (m_fd == -1) {
+        LOG_ERROR("打开用户数据文件%s失败：%s", m_path.c_str(),
+                  strerror(errno));
+        return false;
+    }
+    // 重放会截掉末尾不完整的记录，持有文件锁，避免截掉另一个进程正在写的记录
+    flock(m_fd, LOCK_EX);
+    bool ok = replay();
+    flock(m_fd, LOCK_UN);
+    return ok;
+}
+
+bool LocalStore::replay() {
+    struct stat st;
+    if (fstat(m_fd, &st) == -1) {
+        return false;
+    }
+    off_t len = st.st_size;
+    if (len == 0) {
+        return true;
+    }
+    // 只读映射整个文件顺序解析，解析完即解除映射
+    char* data = (char*)mmap(nullptr, len, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED) {
+        LOG_ERROR("映射用户数据文件%s失败", m_path.c_str());
+        return false;
+    }
+    madvise(data, len, MADV_SEQUENTIAL);
+    off_t pos = apply(data, len);
+    munmap(data, len);
+    if (pos < len) {
+        // 尾部是崩溃时没写完的记录，截掉后新的记录才能接在有效数据之后
+        LOG_ERROR("用户数据文件%s在偏移%lld处损坏，截掉%lld字节", m_path.c_str(),
+                  (long long)pos, (long long)(len - pos));
+        if (ftruncate(m_fd, pos) == -1) {
+            return false;
+        }
+    }
+    m_size = pos;
+    LOG_INFO("从%s重放%zu个用户", m_path.c_str(), m_order.size());
+    return true;
+}
+
+// 顺序解析完整的记录加入索引，遇到不完整或校验失败的记录停止，返回解析掉的字节数
+off_t LocalStore::apply(const char* data, off_t len) {
+    off_t pos = 0;
+    while (pos + (off_t)sizeof(record_header) <= len) {
+        record_header header;
+        memcpy(&header, data + pos, sizeof(header));
+        off_t next = pos + sizeof(header) + header.name_len + header.pwd_len;
+        if (header.name_len == 0 || next > len) {
+            break;
+        }
+        const char* name = data + pos + sizeof(header);
+        const char* pwd = name + header.name_len;
+        if (checksum(name, header.name_len, pwd, header.pwd_len) !=
+            header.sum) {
+            break;
+        }
+        auto ret = m_users.emplace(string(name, header.name_len),
+                                   string(pwd, header.pwd_len));
+        if (ret.second) {
+            m_order.push_back(&*ret.first);
+        }
+        pos = next;
+    }
+    return pos;
+}
+
+// 热升级期间新旧两个进程各自打开数据文件，对方追加的记录不在本进程的索引中；
+// 调用者持有追加锁和文件锁，读入m_size之后的部分
+void LocalStore::catch_up() {
+    struct stat st;
+    if (fstat(m_fd, &st) == -1 || st.st_size <= m_size) {
+        return;
+    }
+    string buf(st.st_size - m_size, '\0');
+    ssize_t n = pread(m_fd, &buf[0], buf.size(), m_size);
+    if (n <= 0) {
+        return;
+    }
+    m_lock.wrlock();
+    size_t before = m_order.size();
+    m_size += apply(buf.data(), n);
+    size_t added = m_order.size() - before;
+    m_lock.unlock();
+    LOG_INFO("从%s读入其他进程写入的%zu个用户", m_path.c_str(), added);
+}
+
+void LocalStore::refresh() {
+    m_append_lock.lock();
+    flock(m_fd, LOCK_SH);
+    catch_up();
+    flock(m_fd, LOCK_UN);
+    m_append_lock.unlock();
+}
+
+bool LocalStore::scan(uint64_t from, const user_visitor& visit) {
+    refresh();
+    m_lock.rdlock();
+    for (size_t i = from; i < m_order.size(); ++i) {
+        visit(i + 1, m_order[i]->first, m_order[i]->second);
+    }
+    m_lock.unlock();
+    return true;
+}
+
+int LocalStore::find(const string& name, string& password) {
+    // 第一次没找到时，先读入另一个进程（热升级期间）刚注册的用户再找一次
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (attempt) {
+            refresh();
+        }
+        m_lock.rdlock();
+        auto it = m_users.find(name);
+        if (it != m_users.end()) {
+            password = it->second;
+            m_lock.unlock();
+            return 1;
+        }
+        m_lock.unlock();
+    }
+    return 0;
+}
+
+UserStore::STORE_RESULT LocalStore::insert(const string& name,
+                                           const string& password) {
+    if (name.empty() || name.size() > UINT16_MAX ||
+        password.size() > UINT16_MAX) {
+        return STORE_FAIL;
+    }
+    // 整条记录拼好后一次write，O_APPEND保证追加到末尾
+    record_header header;
+    header.name_len = name.size();
+    header.pwd_len = password.size();
+    header.sum = checksum(name.data(), name.size(), password.data(),
+                          password.size());
+    string buf((const char*)&header, sizeof(header));
+    buf += name;
+    buf += password;
+
+    // 写盘期间只持有追加锁，查询不会排在fdatasync后面；
+    // m_users只在持有追加锁时修改，这里的重名检查不需要读锁
+    // 文件锁与热升级期间的另一个进程互斥，先读入对方追加的记录再检查重名
+    m_append_lock.lock();
+    flock(m_fd, LOCK_EX);
+    catch_up();
+    if (m_users.count(name)) {
+        flock(m_fd, LOCK_UN);
+        m_append_lock.unlock();
+        return STORE_FAIL;
+    }
+    size_t written = 0;
+    while (written < buf.size()) {
+        ssize_t n = write(m_fd, buf.data() + written, buf.size() - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    if (written < buf.size() || (m_sync && fdatasync(m_fd) == -1)) {
+        // 磁盘写满等错误，去掉写了一半的记录，保持文件末尾干净
+        LOG_ERROR("写入用户数据文件%s失败：%s", m_path.c_str(),
+                  strerror(errno));
+        if (ftruncate(m_fd, m_size) == -1) {
+            LOG_ERROR("截断用户数据文件%s失败", m_path.c_str());
+        }
+        flock(m_fd, LOCK_UN);
+        m_append_lock.unlock();
+        return STORE_BUSY;
+    }
+    m_size += buf.size();
+    // 记录已经落盘，只在发布到索引时短暂加写锁
+    m_lock.wrlock();
+    auto ret = m_users.emplace(name, password);
+    m_order.push_back(&*ret.first);
+    m_lock.unlock();
+    flock(m_fd, LOCK_UN);
+    m_append_lock.unlock();
+    return STORE_OK;
+}
@@ -0,0 +1,60 @@
+#ifndef LOCAL_STORE_H
+#define LOCAL_STORE_H
+
+#include <unordered_map>
+#include "../locker/locker.h"
+#include "user_store.h"
+
+/*
+    本地存储：一个只追加写的日志文件，加一份完整的内存索引
+    1. 每条记录为 {校验和, 用户名长度, 密码长度} + 用户名 + 密码，注册时一次write追加到文件末尾
+    2. 启动时顺序重放整个文件重建索引，记录在文件中的序号就是用户id；
+       末尾不完整或校验失败的记录（写到一半时进程崩溃）被截掉
+    3. sync为true时每次注册后fdatasync，否则只保证进程崩溃不丢数据
+    4. 热升级期间新旧进程同时写同一个文件：追加在flock下进行，写之前先读入对方追加的记录，
+       查询未命中和遍历时也会先读入，两个进程不会注册同名用户
+*/
+class LocalStore : public UserStore {
+   public:
+    LocalStore(const string& path, bool sync)
+        : m_path(path), m_sync(sync), m_fd(-1), m_size(0) {}
+    ~LocalStore();
+
+    const char* name() const override { return "local"; }
+    bool init() override;
+    bool scan(uint64_t from, const user_visitor& visit) override;
+    int find(const string& name, string& password) override;
+    STORE_RESULT insert(const string& name, const string& password) override;
+
+   private:
+    // 记录头，后面紧跟name_len字节的用户名和pwd_len字节的密码
+    struct record_header {
+        uint32_t sum;  // 长度与内容的校验和
+        uint16_t name_len;
+        uint16_t pwd_len;
+    };
+    typedef std::unordered_map<string, string> user_map;
+
+    static uint32_t checksum(const char* name,
+                             size_t name_len,
+                             const char* pwd,
+                             size_t pwd_len);
+    bool replay();  // 重放日志文件重建索引
+    off_t apply(const char* data, off_t len);  // 解析记录加入索引，返回解析掉的字节数
+    void catch_up();  // 读入其他进程追加的记录，需要持有追加锁和文件锁
+    void refresh();   // 加锁后调用catch_up
+
+    string m_path;
+    bool m_sync;
+    int m_fd;
+    off_t m_size;  // 文件中有效记录的总长度
+    user_map m_users;
+    // 按写入顺序排列的用户，下标加一即为用户id；unordered_map的元素地址在扩容时不变
+    std::vector<const user_map::value_type*> m_order;
+    rwlocker m_lock;  // 保护m_users和m_order：发布新用户时加写锁，查询与遍历加读锁
+    // 串行化注册：重名检查、追加写、fdatasync都在这个锁内完成，不阻塞查询，
+    // m_size只在持有它时访问（init之后）
+    locker m_append_lock;
+};
+
+#endif
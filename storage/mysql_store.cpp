@@ -0,0 +1,104 @@
+#include "mysql_store.h"
+#include <stdlib.h>
+#include "../log/log.h"
+
+bool MysqlStore::init() {
+    m_pool = ConnectionPool::get_pool();
+    // 异步数据库查询层，其内部epoll作为一个普通的可读文件描述符挂到主循环上
+    AsyncDB* async_db = AsyncDB::get_instance();
+    if (async_db->init(m_pool)) {
+        m_async_db_fd = async_db->get_fd();
+    } else {
+        LOG_INFO("%s", "异步数据库查询不可用，使用同步连接池");
+    }
+    // 注册批量提交，窗口定时器同样挂到主循环上
+    RegisterBatcher* batcher = RegisterBatcher::get_instance();
+    if (batcher->init(async_db, m_pool->get_batch_size(),
+                      m_pool->get_batch_window())) {
+        m_batcher_fd = batcher->get_fd();
+    }
+    return true;
+}
+
+bool MysqlStore::scan(uint64_t from, const user_visitor& visit) {
+    std::shared_ptr<Connection> p = m_pool->get_connection();
+    if (!p) {
+        LOG_ERROR("获取数据库连接失败\n");
+        return false;
+    }
+    // 用mysql_use_result逐行读取，不在客户端缓存整个结果集，
+    // 启动时的内存峰值与用户表的大小无关
+    string sql = "SELECT id, name, password FROM user_info WHERE id > " +
+                 std::to_string(from);
+    return p->stream_query(sql, [&](MYSQL_ROW row, unsigned long* lengths) {
+        if (!row[0] || !row[1] || !row[2]) {
+            return;
+        }
+        visit(strtoull(row[0], nullptr, 10), string(row[1], lengths[1]),
+              string(row[2], lengths[2]));
+    });
+}
+
+int MysqlStore::find(const string& name, string& password) {
+    // 按name上的唯一索引查单行
+    std::shared_ptr<Connection> p = m_pool->get_connection();
+    if (!p) {
+        return -1;
+    }
+    std::vector<stmt_row> rows;
+    if (!p->execute_query("SELECT password FROM user_info WHERE name = ?",
+                          {name}, rows)) {
+        return -1;
+    }
+    if (rows.empty()) {
+        return 0;
+    }
+    password = rows[0][0];
+    return 1;
+}
+
+UserStore::STORE_RESULT MysqlStore::insert(const string& name,
+                                           const string& password) {
+    std::shared_ptr<Connection> p = m_pool->get_connection();
+    if (!p) {
+        // 数据库连接池在超时时间内没有可用连接
+        return STORE_BUSY;
+    }
+    // 使用预处理语句，参数单独绑定
+    bool ret = p->execute(
+        "INSERT INTO user_info (name, password) VALUES (?, ?)",
+        {name, password});
+    return ret ? STORE_OK : STORE_FAIL;
+}
+
+bool MysqlStore::insert_async(const string& name,
+                              const string& password,
+                              store_callback cb) {
+    RegisterBatcher* batcher = RegisterBatcher::get_instance();
+    if (!batcher->available()) {
+        return false;
+    }
+    return batcher->submit(name, password,
+                           [cb](bool ok, unsigned int) { cb(ok); });
+}
+
+std::vector<int> MysqlStore::event_fds() {
+    std::vector<int> fds;
+    if (m_async_db_fd != -1) {
+        fds.push_back(m_async_db_fd);
+    }
+    if (m_batcher_fd != -1) {
+        fds.push_back(m_batcher_fd);
+    }
+    return fds;
+}
+
+void MysqlStore::on_event(int fd) {
+    if (fd == m_async_db_fd) {
+        // 数据库连接上有事件，推进异步查询，完成的请求会被重新投递到线程池
+        AsyncDB::get_instance()->dispatch();
+    } else if (fd == m_batcher_fd) {
+        // 批量窗口到期，提交攒下的注册
+        RegisterBatcher::get_instance()->on_timer();
+    }
+}
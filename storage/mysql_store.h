@@ -0,0 +1,35 @@
+#ifndef MYSQL_STORE_H
+#define MYSQL_STORE_H
+
+#include "../Connection_pool/asyncDB.h"
+#include "../Connection_pool/connectionPool.h"
+#include "../Connection_pool/registerBatcher.h"
+#include "user_store.h"
+
+/*
+    MySQL存储：读写user_info表
+    查询使用连接池的同步连接，注册优先交给RegisterBatcher批量提交，
+    AsyncDB与批量窗口定时器的文件描述符由主循环监听
+*/
+class MysqlStore : public UserStore {
+   public:
+    MysqlStore() : m_pool(nullptr), m_async_db_fd(-1), m_batcher_fd(-1) {}
+
+    const char* name() const override { return "mysql"; }
+    bool init() override;
+    bool scan(uint64_t from, const user_visitor& visit) override;
+    int find(const string& name, string& password) override;
+    STORE_RESULT insert(const string& name, const string& password) override;
+    bool insert_async(const string& name,
+                      const string& password,
+                      store_callback cb) override;
+    std::vector<int> event_fds() override;
+    void on_event(int fd) override;
+
+   private:
+    ConnectionPool* m_pool;
+    int m_async_db_fd;
+    int m_batcher_fd;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../log/log.h"
+#include "local_store.h"
+
+using namespace std;
+
+// g++ -std=c++17 -O2 test.cpp local_store.cpp ../log/log.cpp ../timer/clock.cpp -pthread -o test
+
+// #define press_insert
+
+static const char* DB_PATH = "./test_users.db";
+
+int main() {
+    Log::get_instance()->init("StorageTestLog", 2000, 800000, 0);
+    unlink(DB_PATH);
+    int errors = 0;
+
+    // 1. 多线程并发注册，同名的注册只有一个成功
+    const int T = 8, N = 2000;
+    {
+        LocalStore store(DB_PATH, false);
+        errors += !store.init();
+        vector<thread> workers;
+        vector<int> ok(T, 0);
+        for (int t = 0; t < T; ++t) {
+            workers.emplace_back([&store, &ok, t]() {
+                for (int i = 0; i < N; ++i) {
+                    // 每个名字被两个线程争抢
+                    string name = "user" + to_string((t / 2) * N + i);
+                    if (store.insert(name, "pwd" + name) == UserStore::STORE_OK) {
+                        ++ok[t];
+                    }
+                }
+            });
+        }
+        for (thread& w : workers) {
+            w.join();
+        }
+        int total = 0;
+        for (int n : ok) {
+            total += n;
+        }
+        errors += total != T / 2 * N;
+        string pwd;
+        errors += store.find("user42", pwd) != 1 || pwd != "pwduser42";
+        errors += store.find("nobody", pwd) != 0;
+    }
+
+    // 2. 重放：id连续且与写入顺序一致；末尾写了一半的记录被截掉
+    int fd = open(DB_PATH, O_WRONLY | O_APPEND);
+    errors += write(fd, "\x12\x34\x56\x78\x05\x00", 6) != 6;
+    close(fd);
+    {
+        LocalStore store(DB_PATH, false);
+        errors += !store.init();
+        uint64_t count = 0, last = 0;
+        store.scan(0, [&](uint64_t id, const string& name, const string& pwd) {
+            errors += id != last + 1 || pwd != "pwd" + name;
+            last = id;
+            ++count;
+        });
+        errors += count != (uint64_t)T / 2 * N;
+        count = 0;
+        store.scan(last - 10, [&](uint64_t, const string&, const string&) {
+            ++count;
+        });
+        errors += count != 10;
+        // 截断后新记录接在有效数据之后，再次重放可以读到
+        errors += store.insert("after_crash", "pwd") != UserStore::STORE_OK;
+    }
+    {
+        LocalStore store(DB_PATH, false);
+        errors += !store.init();
+        string pwd;
+        errors += store.find("after_crash", pwd) != 1;
+    }
+    // 3. 热升级期间两个进程打开同一个文件（这里用两个实例模拟，文件锁按打开的文件区分）：
+    //    同名用户只能注册一次，对方注册的用户可以查到和遍历到
+    {
+        LocalStore old_proc(DB_PATH, false), new_proc(DB_PATH, false);
+        errors += !old_proc.init() || !new_proc.init();
+        vector<thread> workers;
+        vector<int> ok(2, 0);
+        LocalStore* procs[2] = {&old_proc, &new_proc};
+        for (int p = 0; p < 2; ++p) {
+            workers.emplace_back([&procs, &ok, p]() {
+                for (int i = 0; i < N; ++i) {
+                    string name = "upgrade" + to_string(i);
+                    if (procs[p]->insert(name, "pwd" + name) == UserStore::STORE_OK) {
+                        ++ok[p];
+                    }
+                }
+            });
+        }
+        for (thread& w : workers) {
+            w.join();
+        }
+        errors += ok[0] + ok[1] != N;
+        errors += old_proc.insert("only_old", "pwd") != UserStore::STORE_OK;
+        string pwd;
+        errors += new_proc.find("only_old", pwd) != 1 || pwd != "pwd";
+        uint64_t count = 0;
+        new_proc.scan(0, [&](uint64_t, const string&, const string&) { ++count; });
+        errors += count != (uint64_t)T / 2 * N + 1 + N + 1;
+    }
+    printf("%s，错误%d个\n", errors ? "测试失败" : "测试通过", errors);
+
+#ifdef press_insert
+    // 注册吞吐：只写内核缓冲区与每条fdatasync的对比
+    for (int sync = 0; sync <= 1; ++sync) {
+        unlink(DB_PATH);
+        LocalStore store(DB_PATH, sync);
+        store.init();
+        const int M = sync ? 2000 : 200000;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < M; ++i) {
+            store.insert("bench" + to_string(i),
+                         "6e6fdf956d04289354dcf1619e28fe77");
+        }
+        double sec = chrono::duration<double>(chrono::steady_clock::now() -
+                                              start).count();
+        printf("sync=%d：%d次注册 %.0f次/秒\n", sync, M, M / sec);
+        start = chrono::steady_clock::now();
+        LocalStore replay(DB_PATH, false);
+        replay.init();
+        sec = chrono::duration<double>(chrono::steady_clock::now() - start)
+                  .count();
+        printf("重放%d个用户耗时%.1fms\n", M, sec * 1000);
+    }
+#endif
+    unlink(DB_PATH);
+    return errors != 0;
+}
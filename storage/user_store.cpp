@@ -0,0 +1,19 @@
+#include "user_store.h"
+#include "local_store.h"
+#ifndef NO_MYSQL
+#include "mysql_store.h"
+#endif
+
+UserStore* UserStore::create(const Config* config) {
+    string type = config->get_string("storage", "mysql");
+    if (type == "local") {
+        return new LocalStore(config->get_string("localPath", "./users.db"),
+                              config->get_int("localSync", 0) != 0);
+    }
+#ifndef NO_MYSQL
+    if (type == "mysql") {
+        return new MysqlStore();
+    }
+#endif
+    return nullptr;
+}
@@ -0,0 +1,58 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../config/config.h"
+
+using std::string;
+
+/*
+    用户数据的存储后端
+    HTTP层只通过这个接口读写用户，不关心数据存放在哪里：
+    1. mysql：MySQL，注册走异步批量提交
+    2. local：本地追加写的日志文件加内存索引，单机部署和压测时不需要任何外部服务
+    由server.conf中的storage选择，编译时定义NO_MYSQL则只有local可用
+*/
+
+// 遍历用户，id为存储分配的递增编号
+typedef std::function<void(uint64_t id, const string& name, const string& password)>
+    user_visitor;
+// 异步注册的结果，在主线程中回调
+typedef std::function<void(bool ok)> store_callback;
+
+class UserStore {
+   public:
+    enum STORE_RESULT {
+        STORE_OK = 0,  // 写入成功
+        STORE_FAIL,    // 用户已存在或写入失败
+        STORE_BUSY     // 存储暂时不可用，请求应快速返回503
+    };
+
+    // 按配置创建存储后端，不认识的类型返回nullptr
+    static UserStore* create(const Config* config);
+
+    virtual ~UserStore() {}
+    virtual const char* name() const = 0;
+    // 打开存储，在主线程启动时调用一次
+    virtual bool init() = 0;
+    // 读出id大于from的所有用户
+    virtual bool scan(uint64_t from, const user_visitor& visit) = 0;
+    // 查询一个用户，1表示找到，0表示不存在，-1表示出错
+    virtual int find(const string& name, string& password) = 0;
+    // 同步注册一个用户，任意线程均可调用
+    virtual STORE_RESULT insert(const string& name, const string& password) = 0;
+    // 异步注册，成功提交返回true；不支持或暂时不可用时返回false，由调用者改走insert
+    virtual bool insert_async(const string& /*name*/,
+                              const string& /*password*/,
+                              store_callback /*cb*/) {
+        return false;
+    }
+    // 需要加入主循环epoll的文件描述符，可读时由主线程调用on_event
+    virtual std::vector<int> event_fds() { return {}; }
+    virtual void on_event(int /*fd*/) {}
+};
+
+#endif
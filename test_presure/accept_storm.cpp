@@ -0,0 +1,98 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// g++ -std=c++17 -O2 accept_storm.cpp -pthread -o accept_storm
+
+/*
+    连接风暴压测：多个线程不停地建立短连接，每个连接发一个请求、读完响应头后关闭
+    统计每秒完成的连接数，即服务器每秒能accept并处理的新连接数；3秒内没有响应的连接算作失败
+    用法：./accept_storm [ip] [端口] [线程数] [秒数] [路径]
+*/
+
+static atomic<bool> running(true);
+static atomic<long> completed(0), failed(0);
+
+static void storm(sockaddr_in addr, const char* request) {
+    size_t len = strlen(request);
+    char buf[4096];
+    while (running.load(memory_order_relaxed)) {
+        int fd = socket(PF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            failed.fetch_add(1, memory_order_relaxed);
+            continue;
+        }
+        // 关闭时直接发RST，客户端不留TIME_WAIT，避免本地端口耗尽
+        struct linger lg = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        // 全连接队列溢出时握手在客户端看来已经完成，但服务器收不到请求，超时算作失败
+        struct timeval timeout = {3, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        bool ok = connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0 &&
+                  send(fd, request, len, 0) == (ssize_t)len;
+        // 读到响应头结束为止
+        size_t got = 0;
+        while (ok) {
+            ssize_t n = recv(fd, buf + got, sizeof(buf) - 1 - got, 0);
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            got += n;
+            buf[got] = '\0';
+            if (strstr(buf, "\r\n\r\n") || got == sizeof(buf) - 1) {
+                break;
+            }
+        }
+        close(fd);
+        (ok ? completed : failed).fetch_add(1, memory_order_relaxed);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* ip = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 9006;
+    int threads = argc > 3 ? atoi(argv[3]) : 8;
+    int seconds = argc > 4 ? atoi(argv[4]) : 10;
+    const char* path = argc > 5 ? argv[5] : "/0";
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    char request[256];
+    snprintf(request, sizeof(request),
+             "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path,
+             ip);
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(storm, addr, request);
+    }
+    long last = 0;
+    for (int s = 1; s <= seconds; ++s) {
+        this_thread::sleep_for(chrono::seconds(1));
+        long now = completed.load();
+        printf("%2ds: %ld 连接/秒\n", s, now - last);
+        last = now;
+    }
+    running = false;
+    for (thread& t : workers) {
+        t.join();
+    }
+    printf("共完成%ld个连接，失败%ld个，平均%.0f 连接/秒\n", completed.load(),
+           failed.load(), (double)completed.load() / seconds);
+    return 0;
+}
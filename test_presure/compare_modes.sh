@@ -0,0 +1,29 @@
+#!/bin/sh
+# 用同一份webbench负载分别压测Proactor与Reactor两种并发模型
+# 用法（在项目根目录下）：sh test_presure/compare_modes.sh [服务器程序] [端口] [路径] [客户端数] [秒数]
+# 每种模型在临时目录中用server.conf的副本启动，只改concurrency一项，其余配置相同
+# 环境变量CONF可以指定其他配置文件，例如server_local需要storage=local的配置
+
+SERVER=$(realpath ${1:-./server})
+PORT=${2:-9006}
+URL_PATH=${3:-/index.html}
+CLIENTS=${4:-1000}
+SECONDS_RUN=${5:-10}
+WEBBENCH=$(realpath test_presure/webbench-1.5/webbench)
+CONF=$(realpath ${CONF:-server.conf})
+MYSQL_CONF=$(realpath mysql.conf)
+
+for mode in proactor reactor; do
+    dir=$(mktemp -d)
+    grep -v '^concurrency=' "$CONF" > "$dir/server.conf"
+    echo "concurrency=$mode" >> "$dir/server.conf"
+    cp "$MYSQL_CONF" "$dir/"
+    (cd "$dir" && exec "$SERVER" "$PORT" > /dev/null 2>&1) &
+    pid=$!
+    sleep 1
+    echo "== $mode"
+    "$WEBBENCH" -2 -c "$CLIENTS" -t "$SECONDS_RUN" "http://127.0.0.1:$PORT$URL_PATH" 2>&1 | grep -E "Speed|Requests|failed"
+    kill $pid
+    wait $pid 2> /dev/null
+    rm -rf "$dir"
+done
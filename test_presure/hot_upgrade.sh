@@ -0,0 +1,34 @@
+#!/bin/sh
+# 热升级期间不丢连接：连接风暴压测进行到一半时向服务器发送SIGUSR2，新进程接手监听socket，旧进程处理完已有连接后退出
+# 用法（在项目根目录下）：sh test_presure/hot_upgrade.sh [服务器程序] [端口] [秒数]
+# 需要先编译accept_storm（见README），环境变量STORM指定它的位置，CONF指定其他配置文件
+# 服务器在临时目录中用配置文件的副本启动，结果中的失败数应为0
+
+SERVER=$(realpath ${1:-./server})
+PORT=${2:-9006}
+SECONDS_RUN=${3:-10}
+STORM=$(realpath ${STORM:-./accept_storm})
+CONF=$(realpath ${CONF:-server.conf})
+MYSQL_CONF=$(realpath mysql.conf)
+
+dir=$(mktemp -d)
+cp "$CONF" "$dir/server.conf"
+cp "$MYSQL_CONF" "$dir/"
+(cd "$dir" && exec "$SERVER" "$PORT" > /dev/null 2>&1) &
+pid=$!
+sleep 1
+
+"$STORM" 127.0.0.1 "$PORT" 16 "$SECONDS_RUN" /0 &
+storm=$!
+sleep $((SECONDS_RUN / 2))
+echo "== SIGUSR2 -> $pid"
+kill -USR2 $pid
+wait $storm
+wait $pid 2> /dev/null
+
+# 旧进程已经退出，新进程的pid记在日志里
+grep -ah "新进程" "$dir"/*ServerLog*
+new=$(grep -aoh "新进程[0-9]*" "$dir"/*ServerLog* | tail -1 | tr -dc '0-9')
+[ -n "$new" ] && kill $new
+sleep 1
+rm -rf "$dir"
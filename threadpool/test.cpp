@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include "threadpool.h"
+
+using namespace std;
+
+// g++ -std=c++17 -O2 test.cpp -pthread -o test
+
+// 每个任务固定处理5ms，相当于一个工作线程每秒只能处理200个
+struct job {
+    void process() { this_thread::sleep_for(chrono::milliseconds(5)); }
+};
+
+// 以每秒400个的速度提交任务，持续seconds秒，超过处理能力一倍
+// 返回这段时间内最长的排队时间，被准入拒绝的个数写入shed
+static double overload(threadpool<job>* pool, job* j, int seconds, uint64_t& shed) {
+    shed = 0;
+    double max_wait = 0;
+    pool->take_stats();
+    auto end = chrono::steady_clock::now() + chrono::seconds(seconds);
+    while (chrono::steady_clock::now() < end) {
+        if (pool->admit()) {
+            pool->append(j);
+        }
+        this_thread::sleep_for(chrono::microseconds(2500));
+    }
+    // 等已经入队的任务全部被取出，最长排队时间才完整
+    for (;;) {
+        threadpool<job>::stats s = pool->take_stats();
+        shed += s.shed;
+        if (s.max_wait_us / 1000.0 > max_wait) {
+            max_wait = s.max_wait_us / 1000.0;
+        }
+        if (s.depth == 0) {
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    this_thread::sleep_for(chrono::milliseconds(20));
+    return max_wait;
+}
+
+int main() {
+    job j;
+    int errors = 0;
+    uint64_t shed;
+
+    // 1. 不启用准入：积压越来越多，排队时间一直增长
+    threadpool<job>* plain = new threadpool<job>(1, 10000);
+    double plain_wait = overload(plain, &j, 2, shed);
+    printf("no admission: max wait %.0f ms, shed %llu\n", plain_wait,
+           (unsigned long long)shed);
+    errors += shed != 0 || plain_wait < 500;
+
+    // 2. 目标20ms：排队时间持续超过目标后开始拒绝，已准入任务的排队时间有上界
+    threadpool<job>* codel = new threadpool<job>(1, 10000, 20, 100);
+    double codel_wait = overload(codel, &j, 2, shed);
+    printf("admission 20ms/100ms: max wait %.0f ms, shed %llu\n", codel_wait,
+           (unsigned long long)shed);
+    errors += shed == 0 || codel_wait > 200;
+
+    // 3. 积压消化之后立即恢复准入
+    bool ok = codel->admit();
+    printf("after drain: %s\n", ok ? "admitted" : "still shedding");
+    errors += !ok;
+
+    // 4. 短暂的突发不触发拒绝：一次放入10个，排队最多50ms，不到一个interval就消化完
+    threadpool<job>* burst = new threadpool<job>(1, 10000, 20, 100);
+    uint64_t burst_shed = 0;
+    for (int i = 0; i < 10; ++i) {
+        burst_shed += !burst->admit();
+        burst->append(&j);
+    }
+    this_thread::sleep_for(chrono::milliseconds(100));
+    burst_shed += !burst->admit();
+    printf("burst: shed %llu\n", (unsigned long long)burst_shed);
+    errors += burst_shed != 0;
+
+    // 5. 停止：正在处理的任务处理完，排队的不再处理，之后append失败
+    for (int i = 0; i < 10; ++i) {
+        plain->append(&j);
+    }
+    this_thread::sleep_for(chrono::milliseconds(2));
+    auto start = chrono::steady_clock::now();
+    plain->stop();
+    double stop_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    ok = !plain->append(&j);
+    printf("stop: %.1f ms, append after stop %s\n", stop_ms, ok ? "rejected" : "accepted");
+    errors += !ok || stop_ms > 20;
+
+    delete plain;
+    delete codel;
+    delete burst;
+    printf(errors ? "FAILED\n" : "all passed\n");
+    return errors != 0;
+}
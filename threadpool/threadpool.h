@@ -2,7 +2,10 @@
 #define THREADPOOL_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <time.h>
+#include <atomic>
 #include <list>
 #include "../locker/locker.h"
 #include "../log/log.h"
@@ -11,30 +14,89 @@
 template <typename T>
 class threadpool {
    public:
-    /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int threadnumber = 8, int max_requests = 10000);
+    /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量
+      target_ms与interval_ms是按排队时间准入的参数（CoDel）：排队时间在interval_ms内一直
+      超过target_ms，说明队列积压已经消化不掉，开始拒绝新请求；target_ms为0时不启用*/
+    threadpool(int threadnumber = 8, int max_requests = 10000, int target_ms = 0,
+               int interval_ms = 100);
     ~threadpool();
+    // 队列已满或者线程池已经停止时返回false，请求没有入队
     bool append(T* request);
+    // 通知所有工作线程退出并等待它们结束，正在处理的请求会处理完，队列中剩下的请求不再处理
+    // 返回后不会再有工作线程访问请求，可以重复调用
+    void stop();
+    // 新请求入队之前调用，返回false表示队列处于积压状态，应当拒绝这个请求
+    // 已经在处理中的请求（挂起后恢复、没写完的响应）不经过准入，直接append
+    bool admit();
+
+    // 一个统计周期内的运行情况，排队时间为入队到被工作线程取出，处理时间为process的耗时
+    struct stats {
+        size_t depth;          // 当前排队的请求数
+        uint64_t started;      // 被工作线程取出的请求数
+        uint64_t done;         // 处理完成的请求数
+        uint64_t rejected;     // 队列已满被拒绝的请求数
+        uint64_t shed;         // 排队时间超过目标被拒绝的请求数
+        uint64_t wait_us;      // 排队时间之和，微秒
+        uint64_t max_wait_us;  // 最长的排队时间
+        uint64_t service_us;   // 处理时间之和
+    };
+    // 取出上次调用以来的统计，并开始新的统计周期
+    stats take_stats();
 
    private:
+    struct item {
+        T* request;
+        uint64_t enqueue_us;  // 入队时刻，单调时钟
+    };
+    static uint64_t now_us() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void* worker(void* arg);
     void run();
+    // 记录一次排队时间，持有m_listlocker时调用
+    void sample(uint64_t sojourn_us, uint64_t now);
     int m_threadnumber;   // 线程池中的线程数量
     int m_max_requests;   // 请求队列中允许处理的最大任务数
     pthread_t* m_thread;  // 描述线程池的数组，大小为m_threadnumber
-    std::list<T*> m_worklist;  // 工作请求队列，被所有线程共享，因此需要线程同步
+    std::list<item> m_worklist;  // 工作请求队列，被所有线程共享，因此需要线程同步
     locker m_listlocker;  // 保护请求队列的互斥锁
     sem m_liststate;      // 是否有任务需要处理
-    bool m_stop;          // 是否结束线程
+    bool m_stop;          // 是否结束线程，持有m_listlocker时读写
+    uint64_t m_target_us;      // 可以接受的排队时间，0表示不按排队时间准入
+    uint64_t m_interval_us;    // 排队时间持续超过目标多久之后开始拒绝
+    uint64_t m_above_since;    // 排队时间从何时开始一直超过目标，0表示当前没有超过
+    bool m_overloaded;         // 是否正在拒绝新请求
+    // 以下统计中，started、rejected、wait在持有m_listlocker时更新，done、service由工作线程原子累加
+    uint64_t m_started;
+    uint64_t m_rejected;
+    uint64_t m_shed;
+    uint64_t m_wait_us;
+    uint64_t m_max_wait_us;
+    std::atomic<uint64_t> m_done;
+    std::atomic<uint64_t> m_service_us;
 };
 
 template <typename T>
-threadpool<T>::threadpool(int threadnumber, int max_requests)
+threadpool<T>::threadpool(int threadnumber, int max_requests, int target_ms,
+                          int interval_ms)
     : m_threadnumber(threadnumber),
       m_max_requests(max_requests),
       m_thread(nullptr),
-      m_stop(false) {
+      m_stop(false),
+      m_target_us(target_ms > 0 ? (uint64_t)target_ms * 1000 : 0),
+      m_interval_us(interval_ms > 0 ? (uint64_t)interval_ms * 1000 : 0),
+      m_above_since(0),
+      m_overloaded(false),
+      m_started(0),
+      m_rejected(0),
+      m_shed(0),
+      m_wait_us(0),
+      m_max_wait_us(0),
+      m_done(0),
+      m_service_us(0) {
     if (m_threadnumber < 0 || m_max_requests < 0) {
         throw std::exception();
     }
@@ -44,13 +106,12 @@ threadpool<T>::threadpool(int threadnumber, int max_requests)
         throw std::exception();
     }
     // 创建线程，填满线程池
+    // 线程不分离，停止时逐个join，保证析构之后没有线程还在访问线程池和请求
     for (int i = 0; i < m_threadnumber; ++i) {
         if (pthread_create(m_thread + i, nullptr, worker, this) != 0) {
-            delete[] m_thread;
-            throw std::exception();
-        }
-        // 设置线程分离，使得线程的结束由系统接管
-        if (pthread_detach(m_thread[i]) != 0) {
+            // 已经创建的线程先退出，再释放线程数组
+            m_threadnumber = i;
+            stop();
             delete[] m_thread;
             throw std::exception();
         }
@@ -60,25 +121,81 @@ threadpool<T>::threadpool(int threadnumber, int max_requests)
 
 template <typename T>
 threadpool<T>::~threadpool() {
+    stop();
     delete[] m_thread;
+}
+
+template <typename T>
+void threadpool<T>::stop() {
+    m_listlocker.lock();
+    bool stopped = m_stop;
     m_stop = true;
+    m_listlocker.unlock();
+    if (stopped) {
+        return;
+    }
+    // 每个线程一个信号，阻塞在sem_wait上的线程都能醒来看到m_stop
+    for (int i = 0; i < m_threadnumber; ++i) {
+        m_liststate.post();
+    }
+    for (int i = 0; i < m_threadnumber; ++i) {
+        pthread_join(m_thread[i], nullptr);
+    }
 }
 
 // 向请求队列中增加请求（读写任务）
 template <typename T>
 bool threadpool<T>::append(T* request) {
+    uint64_t now = now_us();
     m_listlocker.lock();
-    if (m_worklist.size() > m_max_requests) {
+    if (m_stop || m_worklist.size() >= (size_t)m_max_requests) {
+        ++m_rejected;
         m_listlocker.unlock();
         return false;
     }
     // 在工作队列中添加任务
-    m_worklist.push_back(request);
+    m_worklist.push_back({request, now});
     m_listlocker.unlock();
     m_liststate.post();  // 给定+1信号，说明又有一个新任务需要处理
     return true;
 }
 
+/*
+    排队长度不能反映负载：一个登录请求的开销可能是一个静态文件的上百倍，所以按排队时间判断
+    短暂的突发会让排队时间超过目标，但很快就能消化；只有在一个interval内所有请求的排队时间
+    （即最小值）都超过目标，才说明队列里有消化不掉的积压，这时拒绝新请求，让已排队的请求
+    在目标时间附近完成，而不是所有请求的延迟都变长。一旦有请求在目标时间内被取出就停止拒绝
+*/
+template <typename T>
+void threadpool<T>::sample(uint64_t sojourn_us, uint64_t now) {
+    if (sojourn_us < m_target_us) {
+        m_above_since = 0;
+        m_overloaded = false;
+    } else if (m_above_since == 0) {
+        m_above_since = now;
+    } else if (now - m_above_since >= m_interval_us) {
+        m_overloaded = true;
+    }
+}
+
+template <typename T>
+bool threadpool<T>::admit() {
+    if (m_target_us == 0) {
+        return true;
+    }
+    uint64_t now = now_us();
+    m_listlocker.lock();
+    // 工作线程都卡住时没有请求出队，用队首已经等待的时间作为样本，它是队首最终排队时间的下界；
+    // 队列为空说明没有积压
+    sample(m_worklist.empty() ? 0 : now - m_worklist.front().enqueue_us, now);
+    bool ok = !m_overloaded;
+    if (!ok) {
+        ++m_shed;
+    }
+    m_listlocker.unlock();
+    return ok;
+}
+
 // 工作接口函数，由于pthread_create要求是void* fun(void*)，因此不能直接使用成员函数
 // 成员函数默认会传入一个this指针，因此不符合要求，建立一个静态成员函数，将this传进来
 template <typename T>
@@ -93,24 +210,57 @@ void* threadpool<T>::worker(void* arg) {
 template <typename T>
 void threadpool<T>::run() {
     // 开始处理任务
-    while (!m_stop) {
+    while (true) {
         // 先wait再lock，防止阻塞时上锁
         m_liststate.wait();
         // 加锁是一个阻塞函数，别的队列先上锁会等待别的队列处理完再次尝试上锁
         m_listlocker.lock();
+        if (m_stop) {
+            m_listlocker.unlock();
+            break;
+        }
         if (m_worklist.empty()) {
             m_listlocker.unlock();
             continue;
         }
         // 取出队首请求
-        T* task = m_worklist.front();
+        item front = m_worklist.front();
         m_worklist.pop_front();
+        uint64_t start = now_us();
+        uint64_t wait = start - front.enqueue_us;
+        ++m_started;
+        m_wait_us += wait;
+        if (wait > m_max_wait_us) {
+            m_max_wait_us = wait;
+        }
+        if (m_target_us) {
+            sample(wait, start);
+        }
         m_listlocker.unlock();
-        if (!task) {
+        if (!front.request) {
             continue;
         }
-        task->process();
+        front.request->process();
+        m_service_us.fetch_add(now_us() - start, std::memory_order_relaxed);
+        m_done.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
+template <typename T>
+typename threadpool<T>::stats threadpool<T>::take_stats() {
+    stats s;
+    m_listlocker.lock();
+    s.depth = m_worklist.size();
+    s.started = m_started;
+    s.rejected = m_rejected;
+    s.shed = m_shed;
+    s.wait_us = m_wait_us;
+    s.max_wait_us = m_max_wait_us;
+    m_started = m_rejected = m_shed = m_wait_us = m_max_wait_us = 0;
+    m_listlocker.unlock();
+    s.done = m_done.exchange(0, std::memory_order_relaxed);
+    s.service_us = m_service_us.exchange(0, std::memory_order_relaxed);
+    return s;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "clock.h"
+#include <stdio.h>
+
+// 每个线程各自缓存一份格式化结果，只有跨秒时才重新格式化，避免读写竞争
+struct local_cache {
+    time_t sec = -1;
+    struct tm tm;
+    char log_time[64];
+};
+
+struct gmt_cache {
+    time_t sec = -1;
+    char http_date[64];
+};
+
+static thread_local local_cache t_local;
+static thread_local gmt_cache t_gmt;
+
+static const char* week_name[] = {"Sun", "Mon", "Tue", "Wed",
+                                  "Thu", "Fri", "Sat"};
+static const char* month_name[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+void Clock::update() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    m_mono_ms.store((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000,
+                    std::memory_order_relaxed);
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    m_wall_usec.store(ts.tv_nsec / 1000, std::memory_order_relaxed);
+    m_wall_sec.store(ts.tv_sec, std::memory_order_relaxed);
+}
+
+// 刷新本线程的本地时间缓存
+static void refresh_local(time_t now) {
+    localtime_r(&now, &t_local.tm);
+    const struct tm& t = t_local.tm;
+    snprintf(t_local.log_time, sizeof(t_local.log_time),
+             "%d-%02d-%02d %02d:%02d:%02d", t.tm_year + 1900, t.tm_mon + 1,
+             t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    t_local.sec = now;
+}
+
+const struct tm& Clock::local_tm() const {
+    time_t now = wall_sec();
+    if (t_local.sec != now) {
+        refresh_local(now);
+    }
+    return t_local.tm;
+}
+
+const char* Clock::log_time() const {
+    time_t now = wall_sec();
+    if (t_local.sec != now) {
+        refresh_local(now);
+    }
+    return t_local.log_time;
+}
+
+const char* Clock::http_date() const {
+    time_t now = wall_sec();
+    if (t_gmt.sec != now) {
+        struct tm t;
+        gmtime_r(&now, &t);
+        snprintf(t_gmt.http_date, sizeof(t_gmt.http_date),
+                 "%s, %02d %s %d %02d:%02d:%02d GMT", week_name[t.tm_wday],
+                 t.tm_mday, month_name[t.tm_mon], t.tm_year + 1900, t.tm_hour,
+                 t.tm_min, t.tm_sec);
+        t_gmt.sec = now;
+    }
+    return t_gmt.http_date;
+}
@@ -0,0 +1,49 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <time.h>
+#include <atomic>
+
+/*
+    全局粗粒度时钟
+    主线程在每一轮事件循环开始时调用update()刷新一次时间（CLOCK_MONOTONIC_COARSE与CLOCK_REALTIME_COARSE，
+    走vDSO不陷入内核），定时器、日志、HTTP响应头都从这里读取，不再各自调用time/gettimeofday/localtime。
+    格式化好的秒级字符串按线程缓存，同一秒内重复读取不会再做任何格式化。
+*/
+class Clock {
+   public:
+    // 单例模式，与Log保持一致
+    static Clock* get_instance() {
+        static Clock clock;
+        return &clock;
+    }
+
+    // 刷新缓存的时间，由事件循环每轮调用一次
+    void update();
+
+    // 单调时间（秒/毫秒），定时器使用，不受系统时间调整影响
+    time_t mono_sec() const { return m_mono_ms.load(std::memory_order_relaxed) / 1000; }
+    long long mono_ms() const { return m_mono_ms.load(std::memory_order_relaxed); }
+
+    // 墙上时间，日志使用
+    time_t wall_sec() const { return m_wall_sec.load(std::memory_order_relaxed); }
+    long wall_usec() const { return m_wall_usec.load(std::memory_order_relaxed); }
+
+    // 当前秒的本地时间分解结果
+    const struct tm& local_tm() const;
+    // 日志时间前缀，形如"2023-03-12 22:40:43"
+    const char* log_time() const;
+    // HTTP Date头的值，形如"Sun, 12 Mar 2023 14:40:43 GMT"
+    const char* http_date() const;
+
+   private:
+    Clock() { update(); }
+    Clock(const Clock&) = delete;
+    Clock& operator=(const Clock&) = delete;
+
+    std::atomic<long long> m_mono_ms;  // 单调时钟毫秒数
+    std::atomic<time_t> m_wall_sec;    // 墙上时间秒数
+    std::atomic<long> m_wall_usec;     // 墙上时间微秒部分（粗粒度）
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "timer.h"
+#include "clock.h"
 
 // 升序链表初始化，头尾节点置为空指针
 sort_timer_list::sort_timer_list() : head(nullptr), tail(nullptr) {}
@@ -125,8 +126,8 @@ void sort_timer_list::tick() {
         return;
     }
     printf("%s\n", "timer tick");
-    // 获取当前时间
-    time_t curr = time(nullptr);
+    // 获取当前时间（单调时钟，由事件循环统一刷新）
+    time_t curr = Clock::get_instance()->mono_sec();
     m_timer* temp = head;
     while (temp) {
         // 链表容器为升序排列
@@ -40,7 +40,7 @@ class m_timer {
     m_timer* pre;
     m_timer* next;
     client_data* user_data;  // 每个定时器存一下对应的用户数据
-    time_t expire;           // 到期时间
+    time_t expire;           // 到期时间（单调时钟秒数，见Clock::mono_sec）
     void (*cb_func)(client_data*);
 };
 